@@ -1,8 +1,17 @@
 // TODO: Refactor (move nodes to separate files)
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <ranges>
+#include <utility>
 #include <variant>
 
+#include "Context.hpp"
+#include "EventLoop.hpp"
+#include "Generator.hpp"
 #include "Lexer.hpp"
+#include "Output.hpp"
 #include "Scope.hpp"
 
 using FunctionType = std::function<ValuePtr(const std::vector<ValuePtr>&, ScopePtr)>;
@@ -41,7 +50,6 @@ struct VariableExpr final : ExprNode
         return scope->Get(name)->Evaluate(scope);
     }
 
-    std::weak_ptr<Value> cached;
     std::string name;
 };
 
@@ -53,10 +61,14 @@ struct VariableDecl final : ExprNode
 
     ValuePtr Evaluate(const ScopePtr scope) override
     {
-        const auto evaluated = value->Clone(scope)->Evaluate(scope);
+        const std::pmr::polymorphic_allocator<> allocator(
+            scope ? scope->GetResource() : std::pmr::get_default_resource()
+        );
+
+        const auto evaluated = std::allocate_shared<Value>(allocator, *value->Evaluate(scope));
 
         if(scope)
-            scope->Declare(name, /*name == "this" ? value->Clone(scope) : */std::make_shared<ValueExpr>(evaluated));
+            scope->Declare(name, /*name == "this" ? value->Clone(scope) : */std::allocate_shared<ValueExpr>(allocator, evaluated));
 
         return evaluated;
     }
@@ -66,11 +78,83 @@ struct VariableDecl final : ExprNode
         return std::make_shared<ValueExpr>(value->Clone(scope)->Evaluate(scope));
     }
 
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(value);
+    }
+
     std::string name;
-    std::weak_ptr<Value> cached;
     ExprPtr value;
 };
 
+// var name[size], a buffer of the scope that is released with it
+// The variable holds a pointer like the one alloc returns
+struct ArrayDecl final : ExprNode
+{
+    ArrayDecl(std::string name, ExprPtr size)
+        : name(std::move(name)), size(std::move(size))
+    {}
+
+    ValuePtr Evaluate(const ScopePtr scope) override
+    {
+        auto pointer = Allocate(scope->GetResource(), scope);
+        scope->Declare(name, std::make_shared<ValueExpr>(pointer));
+
+        return pointer;
+    }
+
+    // Structure members live as long as the instance, so they go to the heap
+    ExprPtr Clone(const ScopePtr scope) const override
+    {
+        return std::make_shared<ValueExpr>(Allocate(std::pmr::get_default_resource(), scope));
+    }
+
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(size);
+    }
+
+    std::string name;
+    ExprPtr size;
+
+private:
+    // Owns the elements, the pointer to them is the value of the variable
+    struct Buffer
+    {
+        Buffer(std::pmr::memory_resource* resource, const size_t count)
+            : allocator(resource), data(allocator.allocate(count)), count(count),
+              pointer(reinterpret_cast<size_t>(data))
+        {
+            std::uninitialized_fill_n(data, count, Value(0));
+        }
+
+        ~Buffer()
+        {
+            std::destroy_n(data, count);
+            allocator.deallocate(data, count);
+        }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        std::pmr::polymorphic_allocator<Value> allocator;
+        Value* data;
+        size_t count;
+        Value pointer;
+    };
+
+    ValuePtr Allocate(std::pmr::memory_resource* resource, const ScopePtr& scope) const
+    {
+        const auto count = std::get<int>(*size->Evaluate(scope));
+        if(count <= 0)
+            throw std::runtime_error("Invalid array size");
+
+        const auto buffer = std::allocate_shared<Buffer>(std::pmr::polymorphic_allocator<>(resource), resource, count);
+
+        return { buffer, &buffer->pointer };
+    }
+};
+
 struct ReturnExpr final : ExprNode
 {
     struct ReturnValue
@@ -87,6 +171,11 @@ struct ReturnExpr final : ExprNode
         throw ReturnValue{ value->Evaluate(scope) };
     }
 
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(value);
+    }
+
     ExprPtr value;
 };
 
@@ -120,36 +209,107 @@ struct ContinueExpr final : ExprNode
 
 struct StatementList final : ExprNode
 {
+    using NameVisitor = std::function<void(const std::string&)>;
+
+    struct DeferredBody
+    {
+        std::function<std::vector<ExprPtr>()> parse;
+
+        // Lists the names the body mentions without parsing it
+        std::function<void(const NameVisitor&)> forEachName;
+
+        // Called once the body was parsed, without its lock held
+        std::function<void(StatementList&)> onLoad;
+    };
+
     explicit StatementList(std::vector<ExprPtr>&& statements, std::vector<ExprPtr>&& args = {})
         : statements(std::move(statements)), args(std::move(args))
     {}
 
+    // Function body that is parsed on the first call
+    StatementList(DeferredBody&& deferredBody, std::vector<ExprPtr>&& args)
+        : args(std::move(args)), deferredBody(std::move(deferredBody)), loaded(false)
+    {}
+
     explicit StatementList(FunctionType&& nativeFunc)
         : nativeFunc(std::move(nativeFunc))
     {}
 
+    // The first thread that calls the function parses it, the others wait for it
+    void LoadBody()
+    {
+        if(IsLoaded())
+            return;
+
+        std::function<void(StatementList&)> onLoad;
+        {
+            const std::lock_guard lock(loadMutex);
+
+            if(deferredBody.parse)
+            {
+                statements = deferredBody.parse();
+                onLoad = std::move(deferredBody.onLoad);
+                deferredBody = {};
+            }
+
+            std::atomic_ref(loaded).store(true, std::memory_order_release);
+        }
+
+        if(onLoad)
+            onLoad(*this);
+    }
+
+    bool IsLoaded()
+    {
+        return std::atomic_ref(loaded).load(std::memory_order_acquire);
+    }
+
     ValuePtr Evaluate(const ScopePtr scope) override
+    {
+        return Call(scope, {}, !noLocalScope);
+    }
+
+    // Arguments are passed along instead of being stored in the list, so it can be called from several threads
+    ValuePtr Call(const ScopePtr& scope, const std::vector<ExprPtr>& passed, const bool localScope = true)
     {
         if(nativeFunc)
         {
             std::vector<ValuePtr> evaluatedArgs;
-            evaluatedArgs.reserve(passedArgs.size());
+            evaluatedArgs.reserve(passed.size());
 
-            for(const auto& arg : passedArgs)
+            for(const auto& arg : passed)
                 evaluatedArgs.push_back(arg->Evaluate(scope));
 
             return nativeFunc(evaluatedArgs, scope);
         }
 
-        const auto localScope = noLocalScope ? scope : std::make_shared<Scope>(scope);
+        LoadBody();
+
+        if(!localScope)
+            return EvaluateBody(scope, passed);
 
+        const FrameRegion::Frame frame;
+
+        try
+        {
+            return frame.Keep(EvaluateBody(MakeFrameScope(scope), passed));
+        }
+        catch(ReturnExpr::ReturnValue& returnValue)
+        {
+            returnValue.value = frame.Keep(std::move(returnValue.value));
+            throw;
+        }
+    }
+
+    ValuePtr EvaluateBody(const ScopePtr& localScope, const std::vector<ExprPtr>& passed)
+    {
         for(int i = 0; i < args.size(); i++)
         {
-            if(passedArgs.size() < i + 1)
+            if(passed.size() < i + 1)
                 throw std::runtime_error("Not enough arguments");
 
             const auto& argName = dynamic_cast<VariableDecl*>(args[i].get())->name;
-            localScope->Declare(argName, std::move(passedArgs[i]));
+            localScope->Declare(argName, passed[i]);
         }
 
         ValuePtr result{};
@@ -160,9 +320,39 @@ struct StatementList final : ExprNode
         return result;
     }
 
+    // Bodies that weren't parsed yet have no children, only the names of ForEachName
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        for(const auto& i : args)
+            visitor(i);
+        for(const auto& i : statements)
+            visitor(i);
+    }
+
+    // Returns false when the body was parsed already, then its children have to be visited instead
+    bool ForEachName(const NameVisitor& visitor)
+    {
+        const std::lock_guard lock(loadMutex);
+
+        if(!deferredBody.forEachName)
+            return false;
+
+        deferredBody.forEachName(visitor);
+        return true;
+    }
+
     bool noLocalScope = false;
+    bool isAsync = false;
+    bool isGenerator = false;
     FunctionType nativeFunc{};
-    std::vector<ExprPtr> statements, args, passedArgs;
+    std::vector<ExprPtr> statements, args;
+    DeferredBody deferredBody{};
+
+private:
+    bool loaded = true; // Only accessed atomically
+
+    // Every body has its own, so interpreters don't wait for each other's parsing
+    mutable std::mutex loadMutex;
 };
 
 struct FunctionDecl final : ExprNode
@@ -178,10 +368,15 @@ struct FunctionDecl final : ExprNode
         return nullptr;
     }
 
-    // Not really the right way to clone, but this is needed for structs...
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(body);
+    }
+
+    // Instances share their methods, a call runs in the scope of the instance it is made on
     ExprPtr Clone(const ScopePtr scope) const override
     {
-        return std::make_shared<StatementList>(*std::static_pointer_cast<StatementList>(body));
+        return body;
     }
 
     std::string name;
@@ -204,11 +399,40 @@ struct StructDecl final : ExprNode
         return nullptr;
     }
 
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        for(const auto& value : content | std::views::values)
+            visitor(value);
+    }
+
     std::string name;
     StructBody content;
     Order order;
+
+    // Members declared as var name[size], in declaration order, the constructor doesn't set them
+    Order arrays;
+
+    // Native structures declare their methods in content, this makes the state of each instance
+    std::function<std::any()> nativeInit{};
+
+    // Lets for-in loop over native instances, returns the element at the position and moves past it, nullptr at the end
+    std::function<const Value*(const std::any& state, size_t& position)> nativeNext{};
 };
 
+// The member that holds the state of a native instance, scripts can't name it
+inline const std::string nativeStateMember = "<state>";
+
+// The state of the instance a native method is called on
+template<typename T>
+T& NativeState(const ScopePtr& scope)
+{
+    const auto state = std::any_cast<T>(&std::get<std::any>(*scope->Get(nativeStateMember)->Evaluate(scope)));
+    if(!state)
+        throw std::runtime_error("Method called on an instance of another structure");
+
+    return *state;
+}
+
 // TODO: Review
 struct StructInstance final : ExprNode
 {
@@ -218,8 +442,17 @@ struct StructInstance final : ExprNode
 
     ~StructInstance() override
     {
-        if(localScope->Contains("_" + name))
+        if(!localScope->Contains("_" + name))
+            return;
+
+        // Once the fuel is gone the destructor is cut short, it can't pass the error on
+        const Budget::Destructor destructor;
+
+        try
+        {
             localScope->Get("_" + name)->Evaluate(localScope);
+        }
+        catch(const BudgetExceeded&) {}
     }
 
     ValuePtr Evaluate(const ScopePtr scope) override
@@ -243,28 +476,21 @@ struct ConstructorExpr final : ExprNode
     {
         if(const auto structDecl = dynamic_cast<StructDecl*>(scope->Get(name).get()))
         {
-            auto newScope = std::make_shared<Scope>(globalScope); // A little 'hack'...
-
-            for(const auto& [name, value] : structDecl->content)
-                newScope->Declare(name, value->Clone(newScope));
-
-            auto instance = std::make_shared<StructInstance>(name, newScope);
-
-            newScope->Declare("this",
-                std::make_shared<ValueExpr>(std::weak_ptr(instance))
+            // Instances that never leave their function are kept in its frame
+            const bool keptInFrame = std::atomic_ref(inFrame).load(std::memory_order_relaxed);
+            const std::pmr::polymorphic_allocator<> allocator(
+                keptInFrame ? &FrameRegion::GetRegion() : std::pmr::get_default_resource()
             );
 
+            auto instance = Instantiate(*structDecl, name, allocator);
+            const auto& newScope = instance->localScope;
+
             if(structDecl->content.contains(name))
             {
-                const auto constructorExpr = structDecl->content[name];
+                const auto constructorExpr = structDecl->content.at(name);
 
                 if(const auto constructor = std::static_pointer_cast<FunctionDecl>(constructorExpr))
-                {
-                    const auto body = std::static_pointer_cast<StatementList>(constructor->body);
-                    body->passedArgs = args;
-
-                    body->Evaluate(newScope);
-                }
+                    std::static_pointer_cast<StatementList>(constructor->body)->Call(newScope, args);
             }
             else if(!args.empty())
             {
@@ -275,14 +501,42 @@ struct ConstructorExpr final : ExprNode
                 }
             }
 
-            return std::make_shared<Value>(instance);
+            return std::allocate_shared<Value>(allocator, instance);
         }
 
         throw std::runtime_error(std::format("Symbol '{}' is not a struct", name));
     }
 
+    // A new instance with the default member values, before its constructor runs
+    static StructInstancePtr Instantiate(const StructDecl& structDecl, const std::string& name,
+                                         const std::pmr::polymorphic_allocator<>& allocator)
+    {
+        auto newScope = std::allocate_shared<Scope>(allocator, globalScope, allocator.resource()); // A little 'hack'...
+
+        for(const auto& [member, value] : structDecl.content)
+            newScope->Declare(member, value->Clone(newScope));
+
+        if(structDecl.nativeInit)
+            newScope->Declare(nativeStateMember, std::make_shared<ValueExpr>(structDecl.nativeInit()));
+
+        auto instance = std::allocate_shared<StructInstance>(allocator, name, newScope);
+
+        newScope->Declare("this",
+            std::make_shared<ValueExpr>(std::weak_ptr(instance))
+        );
+
+        return instance;
+    }
+
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        for(const auto& i : args)
+            visitor(i);
+    }
+
     std::string name;
     std::vector<ExprPtr> args;
+    bool inFrame = false; // Set by the escape analysis, while the program runs, only accessed atomically
 };
 
 struct IfStatement final : ExprNode
@@ -300,6 +554,13 @@ struct IfStatement final : ExprNode
         return nullptr;
     }
 
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(condition);
+        visitor(then);
+        visitor(elseExpr);
+    }
+
     ExprPtr condition, then, elseExpr;
 };
 
@@ -315,6 +576,8 @@ struct WhileStatement final : ExprNode
 
         while(ValueOp::toBool(*condition->Evaluate(scope)))
         {
+            Budget::Spend();
+
             try
             {
                 result = body->Evaluate(scope);
@@ -327,6 +590,12 @@ struct WhileStatement final : ExprNode
         return result;
     }
 
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(condition);
+        visitor(body);
+    }
+
     ExprPtr condition, body;
 };
 
@@ -342,18 +611,33 @@ struct ForStatement final : ExprNode
         if((!init || !body) && !condition)
             return nullptr;
 
-        auto localScope = scope;
+        if(!init)
+            return Loop(scope);
 
-        if(init)
+        const FrameRegion::Frame frame;
+        const auto localScope = MakeFrameScope(scope);
+
+        init->Evaluate(localScope);
+
+        try
         {
-            localScope = std::make_shared<Scope>(scope);
-            init->Evaluate(localScope);
+            return frame.Keep(Loop(localScope));
         }
+        catch(ReturnExpr::ReturnValue& returnValue)
+        {
+            returnValue.value = frame.Keep(std::move(returnValue.value));
+            throw;
+        }
+    }
 
+    ValuePtr Loop(const ScopePtr& localScope)
+    {
         ValuePtr result{};
 
         while(!condition || ValueOp::toBool(*condition->Evaluate(localScope)))
         {
+            Budget::Spend();
+
             try
             {
                 result = body->Evaluate(localScope);
@@ -369,9 +653,180 @@ struct ForStatement final : ExprNode
         return result;
     }
 
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(init);
+        visitor(condition);
+        visitor(step);
+        visitor(body);
+    }
+
     ExprPtr init, condition, step, body;
 };
 
+// parfor(var i = begin; i < end; i++), the iterations are split between the threads of the pool
+// Every participant has its own scope with its own copy of the counter
+// Writes to shared variables aren't synchronized, the iterations should write to different elements
+struct ParallelForStatement final : ExprNode
+{
+    ParallelForStatement(std::string name, ExprPtr begin, ExprPtr end, ExprPtr body)
+        : name(std::move(name)), begin(std::move(begin)), end(std::move(end)), body(std::move(body))
+    {}
+
+    ValuePtr Evaluate(const ScopePtr scope) override
+    {
+        const auto from = std::get<int>(*begin->Evaluate(scope));
+        const auto to = std::get<int>(*end->Evaluate(scope));
+
+        auto& pool = ThreadPool::Get();
+        const auto participants = parallelism ? parallelism : pool.GetThreadCount();
+
+        // Whatever was printed before goes out before the output of the iterations
+        console.Flush();
+
+        std::atomic<bool> stopped{};
+
+        pool.For(from, to, participants, [&, context = Context::Current()](const ThreadPool::NextChunk& next)
+        {
+            const Context::Binding binding(context);
+
+            const FrameRegion::Frame frame;
+            const auto localScope = MakeFrameScope(scope);
+
+            const auto counter = std::allocate_shared<Value>(std::pmr::polymorphic_allocator<>(localScope->GetResource()));
+            localScope->Declare(name, std::make_shared<ValueExpr>(counter));
+
+            try
+            {
+                for(int64_t i, last; !stopped.load(std::memory_order_relaxed) && next(i, last);)
+                {
+                    for(; i < last; i++)
+                    {
+                        Budget::Spend();
+
+                        *counter = static_cast<int>(i);
+
+                        try
+                        {
+                            body->Evaluate(localScope);
+                        }
+                        catch(const BreakExpr::Exception&)
+                        {
+                            stopped = true;
+                            break;
+                        }
+                        catch(const ContinueExpr::Exception&) {}
+                    }
+                }
+            }
+            catch(ReturnExpr::ReturnValue& returnValue)
+            {
+                // Returns from the function that runs the loop, once the other participants stop
+                returnValue.value = frame.Keep(std::move(returnValue.value));
+                throw;
+            }
+
+            console.Flush();
+        });
+
+        return nullptr;
+    }
+
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(begin);
+        visitor(end);
+        visitor(body);
+    }
+
+    std::string name;
+    ExprPtr begin, end, body;
+};
+
+// for(var name in generator) pulls one value at a time, so the sequence is never stored
+struct ForInStatement final : ExprNode
+{
+    ForInStatement(std::string name, ExprPtr iterable, ExprPtr body)
+        : name(std::move(name)), iterable(std::move(iterable)), body(std::move(body))
+    {}
+
+    ValuePtr Evaluate(const ScopePtr scope) override
+    {
+        const auto value = iterable->Evaluate(scope);
+
+        const auto any = std::get_if<std::any>(value.get());
+        const auto generator = any ? std::any_cast<GeneratorPtr>(any) : nullptr;
+        const auto instance = any ? std::any_cast<StructInstancePtr>(any) : nullptr;
+
+        if(generator)
+            return Loop(scope, [&generator] { return (*generator)->Next(); });
+
+        // Native structures give their elements without running a generator
+        if(instance)
+        {
+            const auto structDecl = dynamic_cast<StructDecl*>(scope->Get((*instance)->name).get());
+            const auto state = (*instance)->localScope->Find(nativeStateMember);
+
+            if(structDecl && structDecl->nativeNext && state)
+            {
+                const auto stateValue = (*state)->Evaluate(scope);
+                size_t position{};
+
+                return Loop(scope, [&] { return structDecl->nativeNext(std::get<std::any>(*stateValue), position); });
+            }
+        }
+
+        throw std::runtime_error("for-in expects a generator, an array or a map");
+    }
+
+    // Runs the body for every value next gives, until it gives nullptr
+    template<typename Next>
+    ValuePtr Loop(const ScopePtr& scope, const Next& next)
+    {
+        const FrameRegion::Frame frame;
+        const auto localScope = MakeFrameScope(scope);
+
+        const auto element = std::allocate_shared<Value>(std::pmr::polymorphic_allocator<>(localScope->GetResource()));
+        localScope->Declare(name, std::make_shared<ValueExpr>(element));
+
+        ValuePtr result{};
+
+        try
+        {
+            while(const auto value = next())
+            {
+                Budget::Checkpoint();
+                Budget::Spend();
+
+                *element = *value;
+
+                try
+                {
+                    result = body->Evaluate(localScope);
+                }
+                catch(const BreakExpr::Exception&) { break; }
+                catch(const ContinueExpr::Exception&) {}
+            }
+
+            return frame.Keep(std::move(result));
+        }
+        catch(ReturnExpr::ReturnValue& returnValue)
+        {
+            returnValue.value = frame.Keep(std::move(returnValue.value));
+            throw;
+        }
+    }
+
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(iterable);
+        visitor(body);
+    }
+
+    std::string name;
+    ExprPtr iterable, body;
+};
+
 struct FunctionCall final : ExprNode
 {
     FunctionCall(std::string&& name, std::vector<ExprPtr>&& args)
@@ -380,13 +835,18 @@ struct FunctionCall final : ExprNode
 
     ValuePtr Evaluate(const ScopePtr scope) override
     {
-        const auto localScope = std::make_shared<Scope>(scope);
+        Budget::Spend();
+
+        const FrameRegion::Frame frame;
+        const auto localScope = MakeFrameScope(scope);
 
         if(localScope->Contains(name))
         {
             const auto expr = localScope->Get(name).get();
             if(const auto cast = dynamic_cast<StatementList*>(expr))
             {
+                const std::pmr::polymorphic_allocator<> allocator(localScope->GetResource());
+
                 std::vector<ExprPtr> evaluatedArgs;
                 evaluatedArgs.reserve(args.size());
 
@@ -394,24 +854,34 @@ struct FunctionCall final : ExprNode
                     evaluatedArgs.emplace_back(
                         std::dynamic_pointer_cast<ValueExpr>(i)
                         ? i
-                        : std::make_shared<ValueExpr>(i->Evaluate(localScope))
+                        : std::allocate_shared<ValueExpr>(allocator, i->Evaluate(localScope))
                     );
 
-                cast->passedArgs = evaluatedArgs;
-                cast->noLocalScope = true;
+                // Async functions run as coroutines, the call returns the task that await waits for
+                if(cast->isAsync)
+                    return std::make_shared<Value>(std::any(EventLoop::Get().Start(
+                        Detach(localScope->Get(name), FindDetachedOwner(scope, name), evaluatedArgs, localScope)
+                    )));
+
+                // Calls of generators only create them, the function runs when a loop asks for values
+                if(cast->isGenerator)
+                    return std::make_shared<Value>(std::any(std::make_shared<Generator>(
+                        [body = Detach(localScope->Get(name), FindDetachedOwner(scope, name), evaluatedArgs, localScope)] { body(); }
+                    )));
 
                 ValuePtr result{};
 
+                // The call has its own scope already
                 try
                 {
-                    result = expr->Evaluate(localScope);
+                    result = cast->Call(localScope, evaluatedArgs, false);
                 }
                 catch(const ReturnExpr::ReturnValue& returnExpr)
                 {
                     result = returnExpr.value;
                 }
 
-                return result;
+                return frame.Keep(std::move(result));
             }
 
             throw std::runtime_error(std::format("'{}' is not a function", name));
@@ -420,10 +890,89 @@ struct FunctionCall final : ExprNode
         throw std::runtime_error(std::format("Function '{}' not found", name));
     }
 
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        for(const auto& i : args)
+            visitor(i);
+    }
+
+    // Coroutines, generators and spawned tasks outlive the caller's frame, so they get copies of the arguments
+    // and keep the scope they run in alive
+    static std::function<ValuePtr()> Detach(ExprPtr function, ScopePtr owner, const std::vector<ExprPtr>& args, const ScopePtr& scope)
+    {
+        std::vector<ExprPtr> passed;
+        passed.reserve(args.size());
+
+        for(const auto& i : args)
+            passed.push_back(std::make_shared<ValueExpr>(*i->Evaluate(scope)));
+
+        return [function = std::move(function), owner = std::move(owner), passed = std::move(passed)]
+        {
+            try
+            {
+                return std::static_pointer_cast<StatementList>(function)->Call(owner, passed);
+            }
+            catch(const ReturnExpr::ReturnValue& returnValue)
+            {
+                return returnValue.value;
+            }
+        };
+    }
+
     std::string name;
     std::vector<ExprPtr> args;
 };
 
+// Hands a value to the loop that consumes the generator, and waits until it asks for the next one
+struct YieldExpr final : ExprNode
+{
+    explicit YieldExpr(ExprPtr value)
+        : value(std::move(value))
+    {}
+
+    ValuePtr Evaluate(const ScopePtr scope) override
+    {
+        // Stays alive while the generator is suspended, the loop copies it
+        const auto result = value->Evaluate(scope);
+        Generator::Yield(*result);
+
+        return nullptr;
+    }
+
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(value);
+    }
+
+    ExprPtr value;
+};
+
+// Waits for the task of an async call or an I/O built-in, other values are passed through
+struct AwaitExpr final : ExprNode
+{
+    explicit AwaitExpr(ExprPtr expr)
+        : expr(std::move(expr))
+    {}
+
+    ValuePtr Evaluate(const ScopePtr scope) override
+    {
+        auto value = expr->Evaluate(scope);
+
+        if(const auto any = std::get_if<std::any>(value.get()))
+            if(const auto task = std::any_cast<EventLoop::TaskPtr>(any))
+                return EventLoop::Get().Await(*task);
+
+        return value;
+    }
+
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(expr);
+    }
+
+    ExprPtr expr;
+};
+
 struct IndexExpr final : ExprNode
 {
     IndexExpr(ExprPtr expr, ExprPtr index)
@@ -446,7 +995,60 @@ struct IndexExpr final : ExprNode
             return { reinterpret_cast<Value*>(element), [](Value*) {} };
         }
 
-        throw std::runtime_error("Index operator can only be used on pointers");
+        if(const auto array = std::get_if<PackedArray>(ptrValue.get()))
+        {
+            const size_t idx = std::get<int>(*index->Evaluate(scope));
+            return { new Value(ValueOp::LoadElement(*array, idx)), ElementRef{ *array, idx } };
+        }
+
+        // Strings are immutable, so their bytes are read by value
+        if(const auto string = std::get_if<String>(ptrValue.get()))
+            return std::make_shared<Value>(string->At(std::get<int>(*index->Evaluate(scope))));
+
+        throw std::runtime_error("Index operator can only be used on pointers, packed arrays and strings");
+    }
+
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(expr);
+        visitor(index);
+    }
+
+    // Packed elements are copied out, so the assignments store them back, which mapped files refuse
+    struct ElementRef
+    {
+        void operator()(const Value* value) const
+        {
+            delete value;
+        }
+
+        PackedArray array;
+        size_t index;
+    };
+
+    // Elements of the built-in containers are copied out as well, the store looks them up again,
+    // so an element that moved or went away meanwhile is never written through a stale pointer
+    struct StoredRef
+    {
+        void operator()(const Value* value) const
+        {
+            delete value;
+        }
+
+        std::function<void(const Value&)> store;
+    };
+
+    static ValuePtr Reference(const Value& value, std::function<void(const Value&)> store)
+    {
+        return { new Value(value), StoredRef{ std::move(store) } };
+    }
+
+    static void WriteBack(const ValuePtr& value)
+    {
+        if(const auto ref = std::get_deleter<ElementRef>(value))
+            ValueOp::StoreElement(ref->array, ref->index, *value);
+        else if(const auto stored = std::get_deleter<StoredRef>(value))
+            stored->store(*value);
     }
 
     ExprPtr expr, index;
@@ -454,8 +1056,8 @@ struct IndexExpr final : ExprNode
 
 struct UnaryExpr final : ExprNode
 {
-    UnaryExpr(Lexer::Token token, ExprPtr expr)
-        : token(std::move(token)), expr(std::move(expr))
+    UnaryExpr(const Lexer::TokenType operation, ExprPtr expr)
+        : operation(operation), expr(std::move(expr))
     {}
 
     ValuePtr Evaluate(const ScopePtr scope) override
@@ -466,7 +1068,7 @@ struct UnaryExpr final : ExprNode
 
         ValuePtr oldValue{};
 
-        switch(token.first)
+        switch(operation)
         {
         case Lexer::TokenType::Plus: return val;
         case Lexer::TokenType::Minus: return std::make_shared<Value>(-*val);
@@ -478,22 +1080,26 @@ struct UnaryExpr final : ExprNode
             if(operationFirst)
             {
                 *val = *val + 1;
+                IndexExpr::WriteBack(val);
                 return val;
             }
 
             oldValue = std::make_shared<Value>(*val);
             *val = *val + 1;
+            IndexExpr::WriteBack(val);
             return oldValue;
 
         case Lexer::TokenType::Decrement:
             if(operationFirst)
             {
                 *val = *val - 1;
+                IndexExpr::WriteBack(val);
                 return val;
             }
 
             oldValue = std::make_shared<Value>(*val);
             *val = *val - 1;
+            IndexExpr::WriteBack(val);
             return oldValue;
 
         case Lexer::TokenType::Pointer:
@@ -509,23 +1115,27 @@ struct UnaryExpr final : ExprNode
         return val;
     }
 
-    Lexer::Token token;
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(expr);
+    }
+
+    Lexer::TokenType operation;
 
     ExprPtr expr;
-    ValuePtr cachedExpr;
 
     bool operationFirst = true; // That way we can handle prefix/postfix inc/dec
 };
 
 struct BinaryExpr final : ExprNode
 {
-    BinaryExpr(Lexer::Token token, ExprPtr left, ExprPtr right)
-        : token(std::move(token)), left(std::move(left)), right(std::move(right))
+    BinaryExpr(const Lexer::TokenType operation, ExprPtr left, ExprPtr right)
+        : operation(operation), left(std::move(left)), right(std::move(right))
     {}
 
     ValuePtr Evaluate(const ScopePtr scope) override
     {
-        if(token.first == Lexer::TokenType::Dot)
+        if(operation == Lexer::TokenType::Dot)
         {
             const auto structExpr = left->Evaluate(scope);
 
@@ -539,9 +1149,14 @@ struct BinaryExpr final : ExprNode
                 else // It means we're using 'this' inside the struct
                     structInstance = std::any_cast<std::weak_ptr<StructInstance>>(any).lock();
 
-                // TODO: Review...
+                // 'this' kept after its instance was destroyed
+                if(!structInstance)
+                    throw std::runtime_error("Instance no longer exists");
+
+                // Members are looked up in the instance, the parent is the caller's scope
+                // so nothing may keep this scope after the call
                 const auto combinedScope = std::make_shared<Scope>(scope);
-                combinedScope->symbols = structInstance->localScope->symbols;
+                combinedScope->instance = structInstance->localScope;
 
                 return right->Evaluate(combinedScope);
             }
@@ -554,17 +1169,17 @@ struct BinaryExpr final : ExprNode
 
         using namespace ValueOp;
 
-        switch(token.first)
-        {
-        case Lexer::TokenType::Equal: *l = *r; return l;
-        case Lexer::TokenType::AddAssign: *l = *l + *r; return l;
-        case Lexer::TokenType::SubAssign: *l = *l - *r; return l;
-        case Lexer::TokenType::MulAssign: *l = *l * *r; return l;
-        case Lexer::TokenType::DivAssign: *l = *l / *r; return l;
-        case Lexer::TokenType::ModAssign: *l = *l % *r; return l;
-        case Lexer::TokenType::BitwiseAndAssign: *l = *l & *r; return l;
-        case Lexer::TokenType::BitwiseOrAssign: *l = *l | *r; return l;
-        case Lexer::TokenType::BitwiseXorAssign: *l = *l ^ *r; return l;
+        switch(operation)
+        {
+        case Lexer::TokenType::Equal: *l = *r; break;
+        case Lexer::TokenType::AddAssign: *l = *l + *r; break;
+        case Lexer::TokenType::SubAssign: *l = *l - *r; break;
+        case Lexer::TokenType::MulAssign: *l = *l * *r; break;
+        case Lexer::TokenType::DivAssign: *l = *l / *r; break;
+        case Lexer::TokenType::ModAssign: *l = *l % *r; break;
+        case Lexer::TokenType::BitwiseAndAssign: *l = *l & *r; break;
+        case Lexer::TokenType::BitwiseOrAssign: *l = *l | *r; break;
+        case Lexer::TokenType::BitwiseXorAssign: *l = *l ^ *r; break;
         case Lexer::TokenType::Plus: return std::make_shared<Value>(*l + *r);
         case Lexer::TokenType::Minus: return std::make_shared<Value>(*l - *r);
         case Lexer::TokenType::Multiply: return std::make_shared<Value>(*l * *r);
@@ -581,14 +1196,188 @@ struct BinaryExpr final : ExprNode
         case Lexer::TokenType::Greater: return std::make_shared<Value>(*l > *r);
         case Lexer::TokenType::LessEqual: return std::make_shared<Value>(*l <= *r);
         case Lexer::TokenType::GreaterEqual: return std::make_shared<Value>(*l >= *r);
-        default: break;
+        default: return l;
         }
 
+        IndexExpr::WriteBack(l);
+
         return l;
     }
 
-    Lexer::Token token;
+    void ForEachChild(const ChildVisitor& visitor) override
+    {
+        visitor(left);
+        visitor(right);
+    }
+
+    Lexer::TokenType operation;
 
     ExprPtr left, right;
-    std::weak_ptr<Value> cachedLeft, cachedRight;
+};
+
+// Arithmetic and comparisons over variables and constants, packed into one array instead of a tree of nodes
+// Children are 32-bit indices and come before their parent, the intermediate values stay on the stack,
+// so only the result is allocated, and the array is released with the arena without touching reference counts
+struct FlatExpr final : ExprNode
+{
+    struct Node
+    {
+        enum class Kind : uint8_t
+        {
+            Constant, Variable, Operation
+        };
+
+        Kind kind;
+        Lexer::TokenType operation;
+
+        // The operands of an operation, the constant or the name of the others is at left
+        uint32_t left, right;
+    };
+
+    FlatExpr(std::pmr::vector<Node>&& nodes, std::pmr::vector<Value>&& constants, std::pmr::vector<std::string>&& names)
+        : nodes(std::move(nodes)), constants(std::move(constants)), names(std::move(names))
+    {}
+
+    // Trees of at least two operations are worth it, a single one is as fast as a node
+    static ExprPtr Flatten(const BinaryExpr& root)
+    {
+        if(Operations(root) < 2)
+            return nullptr;
+
+        auto flat = MakeNode<FlatExpr>(
+            std::pmr::vector<Node>(nodeArena), std::pmr::vector<Value>(nodeArena), std::pmr::vector<std::string>(nodeArena)
+        );
+        flat->Add(root);
+
+        return flat;
+    }
+
+    ValuePtr Evaluate(const ScopePtr scope) override
+    {
+        return std::make_shared<Value>(Compute(static_cast<uint32_t>(nodes.size() - 1), scope));
+    }
+
+    std::pmr::vector<Node> nodes;
+    std::pmr::vector<Value> constants;
+    std::pmr::vector<std::string> names;
+
+private:
+    static bool IsOperation(const Lexer::TokenType operation)
+    {
+        switch(operation)
+        {
+        case Lexer::TokenType::Plus: case Lexer::TokenType::Minus: case Lexer::TokenType::Multiply:
+        case Lexer::TokenType::Divide: case Lexer::TokenType::Modulo:
+        case Lexer::TokenType::IsEqual: case Lexer::TokenType::NotEqual:
+        case Lexer::TokenType::BitwiseAnd: case Lexer::TokenType::BitwiseOr: case Lexer::TokenType::BitwiseXor:
+        case Lexer::TokenType::And: case Lexer::TokenType::Or:
+        case Lexer::TokenType::Less: case Lexer::TokenType::Greater:
+        case Lexer::TokenType::LessEqual: case Lexer::TokenType::GreaterEqual:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // -1 when something else than variables, constants and operations is part of the tree
+    static int Operations(const ExprNode& node)
+    {
+        if(dynamic_cast<const VariableExpr*>(&node) || dynamic_cast<const ValueExpr*>(&node))
+            return 0;
+
+        if(const auto flat = dynamic_cast<const FlatExpr*>(&node))
+            return static_cast<int>(std::ranges::count(flat->nodes, Node::Kind::Operation, &Node::kind));
+
+        const auto binary = dynamic_cast<const BinaryExpr*>(&node);
+        if(!binary || !IsOperation(binary->operation))
+            return -1;
+
+        const auto left = Operations(*binary->left);
+        const auto right = Operations(*binary->right);
+
+        return left < 0 || right < 0 ? -1 : left + right + 1;
+    }
+
+    uint32_t Add(const ExprNode& node)
+    {
+        if(const auto variable = dynamic_cast<const VariableExpr*>(&node))
+        {
+            names.push_back(variable->name);
+            nodes.push_back({ Node::Kind::Variable, {}, static_cast<uint32_t>(names.size() - 1), 0 });
+        }
+        else if(const auto value = dynamic_cast<const ValueExpr*>(&node))
+        {
+            constants.push_back(*value->value);
+            nodes.push_back({ Node::Kind::Constant, {}, static_cast<uint32_t>(constants.size() - 1), 0 });
+        }
+        // Parenthesized parts were packed by their own parse, their nodes are copied after the ones before them
+        else if(const auto flat = dynamic_cast<const FlatExpr*>(&node))
+        {
+            const auto nodeBase = static_cast<uint32_t>(nodes.size());
+            const auto constantBase = static_cast<uint32_t>(constants.size());
+            const auto nameBase = static_cast<uint32_t>(names.size());
+
+            for(auto copy : flat->nodes)
+            {
+                if(copy.kind == Node::Kind::Operation)
+                    copy.left += nodeBase, copy.right += nodeBase;
+                else
+                    copy.left += copy.kind == Node::Kind::Constant ? constantBase : nameBase;
+
+                nodes.push_back(copy);
+            }
+
+            constants.insert(constants.end(), flat->constants.begin(), flat->constants.end());
+            names.insert(names.end(), flat->names.begin(), flat->names.end());
+        }
+        else
+        {
+            const auto& binary = static_cast<const BinaryExpr&>(node);
+
+            const auto left = Add(*binary.left);
+            const auto right = Add(*binary.right);
+
+            nodes.push_back({ Node::Kind::Operation, binary.operation, left, right });
+        }
+
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+
+    // The same operations as BinaryExpr, in the same order
+    Value Compute(const uint32_t index, const ScopePtr& scope) const
+    {
+        const auto& node = nodes[index];
+
+        if(node.kind == Node::Kind::Constant)
+            return constants[node.left];
+
+        if(node.kind == Node::Kind::Variable)
+            return *scope->Get(names[node.left])->Evaluate(scope);
+
+        const auto l = Compute(node.left, scope);
+        const auto r = Compute(node.right, scope);
+
+        using namespace ValueOp;
+
+        switch(node.operation)
+        {
+        case Lexer::TokenType::Plus: return l + r;
+        case Lexer::TokenType::Minus: return l - r;
+        case Lexer::TokenType::Multiply: return l * r;
+        case Lexer::TokenType::Divide: return l / r;
+        case Lexer::TokenType::Modulo: return l % r;
+        case Lexer::TokenType::IsEqual: return l == r;
+        case Lexer::TokenType::NotEqual: return l != r;
+        case Lexer::TokenType::BitwiseAnd: return l & r;
+        case Lexer::TokenType::BitwiseOr: return l | r;
+        case Lexer::TokenType::BitwiseXor: return l ^ r;
+        case Lexer::TokenType::And: return l && r;
+        case Lexer::TokenType::Or: return l || r;
+        case Lexer::TokenType::Less: return l < r;
+        case Lexer::TokenType::Greater: return l > r;
+        case Lexer::TokenType::LessEqual: return l <= r;
+        case Lexer::TokenType::GreaterEqual: return l >= r;
+        default: return l;
+        }
+    }
 };
@@ -2,6 +2,8 @@
 #include <format>
 #include <functional>
 #include <memory>
+#include <memory_resource>
+#include <unordered_map>
 
 #include "Value.hpp"
 
@@ -12,6 +14,9 @@ struct ASTNode
 };
 
 struct Scope;
+struct ExprNode;
+
+using ChildVisitor = std::function<void(const std::shared_ptr<ExprNode>&)>;
 
 struct ExprNode : ASTNode
 {
@@ -20,6 +25,9 @@ struct ExprNode : ASTNode
     {
         throw std::runtime_error("Expression is not cloneable");
     };
+
+    // Used by the passes that walk the tree before execution
+    virtual void ForEachChild(const ChildVisitor& visitor) {}
 };
 
 struct UndefinedExpr final : ExprNode
@@ -31,4 +39,13 @@ struct UndefinedExpr final : ExprNode
 };
 
 using ExprPtr = std::shared_ptr<ExprNode>;
-using SymbolTable = std::unordered_map<std::string, ExprPtr>;
+using SymbolTable = std::pmr::unordered_map<std::string, ExprPtr>;
+
+// Parsed nodes are kept together and released at once with their interpreter
+inline thread_local std::pmr::memory_resource* nodeArena = std::pmr::get_default_resource();
+
+template<typename T, typename... Args>
+std::shared_ptr<T> MakeNode(Args&&... args)
+{
+    return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(nodeArena), std::forward<Args>(args)...);
+}
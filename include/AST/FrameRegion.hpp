@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include "Value.hpp"
+
+// Stack-like storage for the scopes and locals of calls and blocks
+// Everything allocated inside a frame is dropped at once when the frame ends
+class FrameRegion final : public std::pmr::memory_resource
+{
+public:
+    struct Mark
+    {
+        size_t chunk{}, offset{};
+    };
+
+    class Frame
+    {
+    public:
+        Frame() : mark(region.GetMark()) {}
+        ~Frame() { region.Release(mark); }
+
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+
+        // Values that outlive the frame are moved to the heap
+        ValuePtr Keep(ValuePtr value) const
+        {
+            if(value && region.Contains(value.get(), mark))
+                return std::make_shared<Value>(*value);
+
+            return value;
+        }
+
+    private:
+        FrameRegion& region = GetRegion();
+        Mark mark;
+    };
+
+    FrameRegion() = default;
+    ~FrameRegion() override = default;
+
+    static FrameRegion& GetRegion()
+    {
+        thread_local FrameRegion region;
+        return active ? *active : region;
+    }
+
+    // Coroutines have their own region, as their frames end in a different order than the thread's
+    static inline thread_local FrameRegion* active{};
+
+    Mark GetMark() const
+    {
+        return { current, offset };
+    }
+
+    // Chunks are kept, so the next frames don't allocate
+    void Release(const Mark mark)
+    {
+        current = mark.chunk;
+        offset = mark.offset;
+    }
+
+    bool Contains(const void* ptr, const Mark mark) const
+    {
+        const auto address = static_cast<const std::byte*>(ptr);
+
+        for(auto i = mark.chunk; i <= current && i < chunks.size(); i++)
+        {
+            const auto begin = chunks[i].data.get() + (i == mark.chunk ? mark.offset : 0);
+            const auto end = chunks[i].data.get() + (i == current ? offset : chunks[i].size);
+
+            if(address >= begin && address < end)
+                return true;
+        }
+
+        return false;
+    }
+
+private:
+    void* do_allocate(const size_t bytes, const size_t alignment) override
+    {
+        while(true)
+        {
+            if(current < chunks.size())
+            {
+                const auto aligned = (offset + alignment - 1) & ~(alignment - 1);
+
+                if(aligned + bytes <= chunks[current].size)
+                {
+                    offset = aligned + bytes;
+                    return chunks[current].data.get() + aligned;
+                }
+
+                if(current + 1 < chunks.size())
+                {
+                    current++;
+                    offset = 0;
+                    continue;
+                }
+            }
+
+            const auto size = std::max(chunkSize, bytes + alignment);
+            chunks.push_back({ std::make_unique<std::byte[]>(size), size });
+
+            current = chunks.size() - 1;
+            offset = 0;
+        }
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    struct Chunk
+    {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    static constexpr size_t chunkSize = 64 * 1024;
+
+    std::vector<Chunk> chunks;
+    size_t current{}, offset{};
+};
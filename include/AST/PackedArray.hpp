@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Buffer made by the alloc_* built-ins, numbers are kept in their native representation
+struct PackedArray
+{
+    enum class Type : uint8_t
+    {
+        I32, I64, F32, F64, U8
+    };
+
+    // Heap arrays are released with free, mapped files with munmap_file
+    enum class Origin : uint8_t
+    {
+        Heap, Mapped
+    };
+
+    // Copies of a mapped array point to the same mapping, so munmap_file clears the bytes for all of them
+    struct Mapping
+    {
+        void* bytes;
+        void* address;
+        size_t length;
+    };
+
+    size_t ElementSize() const
+    {
+        switch(type)
+        {
+        case Type::I32: return sizeof(int32_t);
+        case Type::I64: return sizeof(int64_t);
+        case Type::F32: return sizeof(float);
+        case Type::F64: return sizeof(double);
+        case Type::U8: return sizeof(uint8_t);
+        }
+
+        return 0;
+    }
+
+    template<typename T>
+    T* Data() const
+    {
+        if(origin == Origin::Heap || !data)
+            return static_cast<T*>(data);
+
+        const auto bytes = static_cast<const Mapping*>(data)->bytes;
+        if(!bytes)
+            throw std::runtime_error("The file is no longer mapped");
+
+        return static_cast<T*>(bytes);
+    }
+
+    // Mapped files are read-only
+    template<typename T>
+    T* MutableData() const
+    {
+        if(origin == Origin::Mapped)
+            throw std::runtime_error("Mapped files are read-only");
+
+        return Data<T>();
+    }
+
+    bool operator==(const PackedArray& other) const = default;
+
+    // The elements, or the Mapping of mapped files
+    void* data;
+    uint32_t size;
+    Type type;
+    Origin origin = Origin::Heap;
+};
@@ -1,10 +1,12 @@
 #pragma once
 #include "Base.hpp"
+#include "FrameRegion.hpp"
 
 struct Scope
 {
-    explicit Scope(const std::shared_ptr<Scope>& parent = {})
-        : parent(parent)
+    explicit Scope(const std::shared_ptr<Scope>& parent = {},
+                   std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : parent(parent), symbols(resource)
     {}
 
     void Declare(const std::string& name, ExprPtr value)
@@ -19,29 +21,102 @@ struct Scope
 
     ExprPtr& Get(const std::string& name)
     {
-        if(const auto it = symbols.find(name); it != symbols.end())
-            return it->second;
+        if(const auto found = Find(name))
+            return *found;
 
-        if(const auto ptr = parent.lock())
-        {
-            // Some kind of caching
-            const auto& result = ptr->Get(name);
-            return symbols[name] = result;
-        }
+        // Lookups don't write to the scopes, as other threads might read them
+        for(auto ptr = parent.lock(); ptr; ptr = ptr->parent.lock())
+            if(const auto found = ptr->Find(name))
+                return *found;
 
         throw std::runtime_error(std::format("Symbol '{}' not found", name));
     }
 
+    // Method calls see the members of their instance without copying them
+    ExprPtr* Find(const std::string& name)
+    {
+        if(const auto it = symbols.find(name); it != symbols.end())
+            return &it->second;
+
+        if(instance)
+            if(const auto it = instance->symbols.find(name); it != instance->symbols.end())
+                return &it->second;
+
+        return nullptr;
+    }
+
+    bool Declares(const std::string& name) const
+    {
+        return symbols.contains(name) || (instance && instance->symbols.contains(name));
+    }
+
+    // Locals are allocated the same way as the scope that holds them
+    std::pmr::memory_resource* GetResource() const
+    {
+        return symbols.get_allocator().resource();
+    }
+
     bool Contains(const std::string& name) const
     {
         const auto ptr = parent.lock();
-        return symbols.contains(name) || (ptr && ptr->Contains(name));
+        return Declares(name) || (ptr && ptr->Contains(name));
     }
 
     std::weak_ptr<Scope> parent;
     SymbolTable symbols;
+
+    // Set on the scopes method calls run in, the scope of their instance
+    std::shared_ptr<Scope> instance;
 };
 
 using ScopePtr = std::shared_ptr<Scope>;
 
-inline auto globalScope = std::make_shared<Scope>();
+// The scope lives in the current frame, so it must not outlive it
+inline ScopePtr MakeFrameScope(const ScopePtr& parent)
+{
+    auto& region = FrameRegion::GetRegion();
+    return std::allocate_shared<Scope>(std::pmr::polymorphic_allocator<Scope>(&region), parent, &region);
+}
+
+// Scopes of calls and blocks, and instances kept in frames, are allocated from a frame region
+inline bool IsInFrame(const Scope& scope)
+{
+    return dynamic_cast<FrameRegion*>(scope.GetResource());
+}
+
+// The scope that declares the name, for calls that may outlive the caller's frame
+inline ScopePtr FindOwner(ScopePtr scope, const std::string& name)
+{
+    while(scope && !scope->Declares(name))
+        scope = scope->parent.lock();
+
+    if(!scope)
+        throw std::runtime_error(std::format("Function '{}' not found", name));
+
+    return scope;
+}
+
+// The scope for calls that outlive the caller's frame, like coroutines, generators and spawned tasks
+// Frames are rewound when their call returns, so functions declared in one run in the nearest scope on the heap,
+// where they only see their parameters and what is declared there. Methods run in their instance
+inline ScopePtr FindDetachedOwner(const ScopePtr& scope, const std::string& name)
+{
+    for(auto owner = FindOwner(scope, name); owner; owner = owner->parent.lock())
+    {
+        if(owner->instance)
+        {
+            if(IsInFrame(*owner->instance))
+                throw std::runtime_error(std::format("Method '{}' can't outlive an instance kept in a frame", name));
+
+            return owner->instance;
+        }
+
+        if(!IsInFrame(*owner))
+            return owner;
+    }
+
+    throw std::runtime_error(std::format("Function '{}' has no scope outside of the frame", name));
+}
+
+// Built-ins and structures of the interpreter running on this thread
+inline thread_local ScopePtr globalScope;
@@ -0,0 +1,178 @@
+#pragma once
+#include <atomic>
+#include <compare>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+// Immutable byte string, short ones are stored inline and long ones share a buffer
+// Always null-terminated, so the data can be passed around like a C string
+class String
+{
+public:
+    String()
+    {
+        SetInline(0);
+    }
+
+    explicit String(const std::string_view view)
+    {
+        char* data;
+
+        if(view.size() <= inlineCapacity)
+        {
+            SetInline(view.size());
+            data = storage;
+        }
+        else
+            data = Allocate(view.size())->Data();
+
+        std::memcpy(data, view.data(), view.size());
+        data[view.size()] = '\0';
+    }
+
+    String(const String& other)
+    {
+        std::memcpy(storage, other.storage, sizeof(storage));
+
+        if(IsShared())
+            GetBuffer()->references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    String(String&& other) noexcept
+    {
+        std::memcpy(storage, other.storage, sizeof(storage));
+        other.SetInline(0);
+    }
+
+    String& operator=(String other) noexcept
+    {
+        std::swap(storage, other.storage);
+        return *this;
+    }
+
+    ~String()
+    {
+        if(!IsShared())
+            return;
+
+        if(const auto buffer = GetBuffer(); buffer->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            buffer->~Buffer();
+            ::operator delete(buffer);
+        }
+    }
+
+    const char* Data() const
+    {
+        return IsShared() ? GetBuffer()->Data() : storage;
+    }
+
+    size_t Size() const
+    {
+        return IsShared() ? GetBuffer()->size : static_cast<unsigned char>(storage[tagIndex]);
+    }
+
+    std::string_view View() const
+    {
+        return { Data(), Size() };
+    }
+
+    // The terminator can be read too, as C-style loops rely on it
+    char At(const size_t index) const
+    {
+        if(index > Size())
+            throw std::runtime_error("String index out of range");
+
+        return Data()[index];
+    }
+
+    String Slice(const size_t begin, const size_t end) const
+    {
+        if(begin > end || end > Size())
+            throw std::runtime_error("Invalid string slice");
+
+        return String(View().substr(begin, end - begin));
+    }
+
+    static String Concat(const std::string_view left, const std::string_view right)
+    {
+        String result;
+        char* data;
+
+        if(left.size() + right.size() <= inlineCapacity)
+        {
+            result.SetInline(left.size() + right.size());
+            data = result.storage;
+        }
+        else
+            data = result.Allocate(left.size() + right.size())->Data();
+
+        std::memcpy(data, left.data(), left.size());
+        std::memcpy(data + left.size(), right.data(), right.size());
+        data[left.size() + right.size()] = '\0';
+
+        return result;
+    }
+
+    bool operator==(const String& other) const
+    {
+        return View() == other.View();
+    }
+
+    std::strong_ordering operator<=>(const String& other) const
+    {
+        return View() <=> other.View();
+    }
+
+private:
+    struct Buffer
+    {
+        std::atomic<size_t> references;
+        size_t size;
+
+        char* Data()
+        {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    bool IsShared() const
+    {
+        return static_cast<unsigned char>(storage[tagIndex]) == sharedTag;
+    }
+
+    Buffer* GetBuffer() const
+    {
+        Buffer* buffer;
+        std::memcpy(&buffer, storage, sizeof(buffer));
+
+        return buffer;
+    }
+
+    void SetInline(const size_t size)
+    {
+        storage[size] = '\0';
+        storage[tagIndex] = static_cast<char>(size);
+    }
+
+    Buffer* Allocate(const size_t size)
+    {
+        const auto buffer = new(::operator new(sizeof(Buffer) + size + 1)) Buffer{ 1, size };
+
+        std::memcpy(storage, &buffer, sizeof(buffer));
+        storage[tagIndex] = static_cast<char>(sharedTag);
+
+        return buffer;
+    }
+
+private:
+    // The last byte holds either the inline size or the shared tag
+    static constexpr size_t tagIndex = 15;
+    static constexpr size_t inlineCapacity = tagIndex - 1;
+    static constexpr unsigned char sharedTag = 0xFF;
+
+    alignas(Buffer*) char storage[16];
+};
@@ -1,9 +1,15 @@
 #pragma once
 #include <any>
+#include <format>
 #include <memory>
+#include <stdexcept>
+#include <utility>
 #include <variant>
 
-using Value = std::variant<int, size_t, float, double, bool, char, std::any>;
+#include "PackedArray.hpp"
+#include "String.hpp"
+
+using Value = std::variant<int, size_t, float, double, bool, char, String, PackedArray, std::any>;
 using ValuePtr = std::shared_ptr<Value>;
 
 namespace ValueOp
@@ -164,6 +170,55 @@ inline Value operator>=(const Value& left, const Value& right)
     }, left, right);
 }
 
+// Elements of packed arrays are seen as the closest script type,
+// so 64-bit and byte elements are read as int, 64-bit ones that don't fit are errors
+inline Value LoadElement(const PackedArray& array, const size_t index)
+{
+    if(index >= array.size)
+        throw std::runtime_error("Index out of range");
+
+    switch(array.type)
+    {
+    case PackedArray::Type::I32: return array.Data<int32_t>()[index];
+    case PackedArray::Type::I64:
+    {
+        const auto element = array.Data<int64_t>()[index];
+        if(!std::in_range<int>(element))
+            throw std::runtime_error(std::format("Element {} doesn't fit in an int", element));
+
+        return static_cast<int>(element);
+    }
+    case PackedArray::Type::F32: return array.Data<float>()[index];
+    case PackedArray::Type::F64: return array.Data<double>()[index];
+    case PackedArray::Type::U8: return static_cast<int>(array.Data<uint8_t>()[index]);
+    }
+
+    return 0;
+}
+
+template<typename T>
+T ToNumber(const Value& val)
+{
+    return std::visit([](auto&& v) -> T
+    {
+        if constexpr (std::is_arithmetic_v<std::decay_t<decltype(v)>>)
+            return static_cast<T>(v);
+        throw std::runtime_error("Packed arrays can only hold numbers");
+    }, val);
+}
+
+inline void StoreElement(const PackedArray& array, const size_t index, const Value& val)
+{
+    switch(array.type)
+    {
+    case PackedArray::Type::I32: array.MutableData<int32_t>()[index] = ToNumber<int32_t>(val); break;
+    case PackedArray::Type::I64: array.MutableData<int64_t>()[index] = ToNumber<int64_t>(val); break;
+    case PackedArray::Type::F32: array.MutableData<float>()[index] = ToNumber<float>(val); break;
+    case PackedArray::Type::F64: array.MutableData<double>()[index] = ToNumber<double>(val); break;
+    case PackedArray::Type::U8: array.MutableData<uint8_t>()[index] = ToNumber<uint8_t>(val); break;
+    }
+}
+
 inline bool toBool(const Value& val)
 {
     return std::visit([](auto&& v) -> bool
@@ -0,0 +1,129 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Backs the alloc/realloc/free built-ins
+// Small blocks come from per-thread free lists of a few size classes,
+// large blocks go straight to malloc
+// Every instance has its own lists and slabs, everything it handed out is released with it
+class Allocator
+{
+public:
+    struct Stats
+    {
+        size_t liveBytes{}, peakBytes{}, allocations{}, reallocations{}, frees{};
+    };
+
+    Allocator();
+    ~Allocator();
+
+    Allocator(const Allocator&) = delete;
+    Allocator& operator=(const Allocator&) = delete;
+
+    void* Allocate(size_t size);
+    void* Reallocate(void* ptr, size_t size);
+    void Free(void* ptr);
+
+    // Double frees and foreign pointers are reported in the checked mode
+    void SetChecked(bool checked);
+
+    // Most bytes the live blocks may hold, 0 means no limit
+    // Allocations past it throw BudgetExceeded
+    void SetQuota(size_t bytes);
+
+    Stats GetStats() const;
+
+private:
+    struct BlockHeader
+    {
+        uint32_t sizeClass;
+        uint32_t reserved;
+        size_t size;
+    };
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct Slab
+    {
+        char* position;
+        char* end;
+    };
+
+    static constexpr std::array<size_t, 8> classSizes = { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    static constexpr uint32_t largeBlock = classSizes.size();
+    static constexpr size_t slabSize = 64 * 1024;
+
+    // Lists and slabs one thread uses without locking
+    // Blocks may be freed by another thread, they just end up in its cache
+    struct Cache
+    {
+        Cache() = default;
+        ~Cache();
+
+        Cache(const Cache&) = delete;
+        Cache& operator=(const Cache&) = delete;
+
+        std::array<FreeBlock*, classSizes.size()> freeLists{};
+        std::array<Slab, classSizes.size()> slabs{};
+        std::vector<char*> slabMemory;
+    };
+
+    void* AllocateBlock(size_t size);
+
+    static uint32_t GetSizeClass(size_t size);
+    Cache& GetCache();
+    static BlockHeader* Carve(Cache& cache, uint32_t sizeClass);
+
+    void TrackLarge(BlockHeader* header, BlockHeader* replaced);
+
+    void Validate(void* ptr);
+    void Register(void* ptr);
+    void Unregister(void* ptr);
+
+    void AddLiveBytes(ptrdiff_t size);
+    void CheckQuota(size_t growth) const;
+
+    // The cache used last on this thread, the ids of destroyed instances are never reused
+    struct CacheRef
+    {
+        uint64_t owner;
+        Cache* cache;
+    };
+
+    static thread_local CacheRef lastCache;
+    static inline std::atomic<uint64_t> nextId = 1;
+
+    // Only so many frees are remembered for the double free check
+    static constexpr size_t maxFreedKept = 64 * 1024;
+
+private:
+    const uint64_t id;
+
+    std::mutex blocksMutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<Cache>> caches;
+    std::unordered_set<BlockHeader*> largeBlocks;
+
+    std::atomic<size_t> liveBytes{}, peakBytes{}, allocations{}, reallocations{}, frees{};
+
+    std::atomic<size_t> quota{};
+
+    std::atomic<bool> checked{};
+    std::mutex checkedMutex;
+    std::unordered_set<void*> liveBlocks, freedBlocks;
+    std::deque<void*> freedOrder;
+};
+
+// The heap of the interpreter running on this thread
+inline thread_local Allocator* heap{};
@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+class Fiber;
+
+// Thrown when a program runs out of fuel or memory and can't pause
+struct BudgetExceeded : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+// Fuel of one interpreter, so untrusted programs can't hold a core forever
+// Loop iterations and function calls spend one unit each. Threads take fuel from the shared pool in slices,
+// so the hot path only decrements a thread-local counter
+class Budget
+{
+public:
+    static constexpr int64_t unlimited = std::numeric_limits<int64_t>::max();
+
+    // What destructors of script structures may still spend after the fuel ran out
+    static constexpr int64_t destructorFuel = 16 * 1024;
+
+    void SetFuel(int64_t fuel);
+
+    // Pays back borrowed fuel first
+    void AddFuel(int64_t fuel);
+
+    // Negative after other threads or fibers ran on borrowed fuel
+    int64_t GetFuel() const;
+
+    // Running out of fuel on this fiber pauses it instead of stopping the program
+    // Other threads, coroutines and generators can't pause there, they borrow up to a limit and the next fuel pays it back
+    void SetPausable(Fiber* fiber);
+
+    // Called at loop back-edges and function calls
+    static void Spend()
+    {
+        if(--sliceLeft < 0) [[unlikely]]
+            Refill();
+    }
+
+    // Called where generators and coroutines hand control back, pauses the program if they borrowed fuel
+    static void Checkpoint()
+    {
+        if(bound && bound->fuel.load(std::memory_order_relaxed) < 0) [[unlikely]]
+            Settle();
+    }
+
+    // Script destructors can't pause or pass errors on, so while one runs on this thread the fuel is borrowed
+    // like on other threads, and BudgetExceeded ends only the destructor
+    class Destructor
+    {
+    public:
+        Destructor() { destructorDepth++; }
+        ~Destructor() { destructorDepth--; }
+
+        Destructor(const Destructor&) = delete;
+        Destructor& operator=(const Destructor&) = delete;
+    };
+
+    // Makes the budget the one this thread spends, the rest of the previous one's slice goes back to it
+    static Budget* Bind(Budget* next);
+
+    // The budget this thread spends
+    static Budget* Current();
+
+private:
+    static void Refill();
+    static void Settle();
+
+private:
+    static constexpr int64_t sliceSize = 1024;
+    static constexpr int64_t maxBorrowed = 1024 * sliceSize;
+    static constexpr int64_t unwindSlices = destructorFuel / sliceSize;
+
+    std::atomic<int64_t> fuel = unlimited;
+    std::atomic<Fiber*> pausable{};
+
+    static inline thread_local Budget* bound{};
+    static inline thread_local int64_t sliceLeft{};
+    static inline thread_local int64_t unwindLeft = unwindSlices;
+    static inline thread_local size_t destructorDepth{};
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+#include "Allocator.hpp"
+#include "Budget.hpp"
+#include "FileMappings.hpp"
+#include "ThreadPool.hpp"
+#include "AST/Scope.hpp"
+
+// The interpreter state that nodes and built-ins reach through thread-local variables
+struct Context
+{
+    ScopePtr globals;
+    std::pmr::memory_resource* arena;
+    Allocator* heap;
+    FileMappings* mappings;
+    Budget* budget;
+    size_t parallelism;
+
+    // Spawned tasks that haven't finished, the interpreter waits for them before it ends
+    std::shared_ptr<std::atomic<size_t>> tasks;
+
+    static Context Current()
+    {
+        return { globalScope, nodeArena, ::heap, fileMappings, Budget::Current(), ::parallelism, spawnedTasks };
+    }
+
+    // Makes the context current on this thread, until the binding ends
+    class Binding
+    {
+    public:
+        explicit Binding(const Context& context)
+            : globals(std::exchange(globalScope, context.globals)),
+              arena(std::exchange(nodeArena, context.arena)),
+              heap(std::exchange(::heap, context.heap)),
+              mappings(std::exchange(fileMappings, context.mappings)),
+              budget(Budget::Bind(context.budget)),
+              parallelism(std::exchange(::parallelism, context.parallelism)),
+              tasks(std::exchange(spawnedTasks, context.tasks))
+        {}
+
+        ~Binding()
+        {
+            globalScope = std::move(globals);
+            nodeArena = arena;
+            ::heap = heap;
+            fileMappings = mappings;
+            Budget::Bind(budget);
+            ::parallelism = parallelism;
+            spawnedTasks = std::move(tasks);
+        }
+
+        Binding(const Binding&) = delete;
+        Binding& operator=(const Binding&) = delete;
+
+    private:
+        // The context that was current before
+        ScopePtr globals;
+        std::pmr::memory_resource* arena;
+        Allocator* heap;
+        FileMappings* mappings;
+        Budget* budget;
+        size_t parallelism;
+        std::shared_ptr<std::atomic<size_t>> tasks;
+    };
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "AST/AST.hpp"
+
+// Finds structure instances that never leave the function they were created in,
+// so they can be kept in its frame instead of the heap
+// Only 'var x = T()' statements are considered, everything unclear counts as an escape
+// Bodies are only analyzed once they were parsed, until then everything passed to them escapes
+class EscapeAnalysis
+{
+public:
+    EscapeAnalysis() = default;
+    ~EscapeAnalysis() = default;
+
+    // Analyzes the bodies that are parsed already
+    void Run(const ScopePtr& programScope);
+
+    // Analyzes the program again after a function it uses was parsed, it may be called on any thread
+    void BodyLoaded(StatementList& body);
+
+    // Returns the amount of constructors, whose instances are kept in frames
+    size_t GetKept() const;
+
+private:
+    struct Function
+    {
+        ExprPtr body;
+        std::vector<std::string> params;
+        std::vector<bool> escapes;
+        bool outlivesCaller{};
+        bool analyzed{};
+    };
+
+    // Marking only ever adds constructors, as a parsed body lets no more escape than one that wasn't parsed
+    void Update();
+
+    void AnalyzeParams();
+    void AnalyzeStructs();
+
+    size_t MarkConstructors(const ExprPtr& node, const ExprPtr& function);
+
+    bool Escapes(const ExprPtr& node, const std::string& name) const;
+    bool ArgumentEscapes(const FunctionCall& call, size_t index) const;
+
+    static bool IsVariable(const ExprPtr& node, const std::string& name);
+
+private:
+    std::unordered_map<std::string, Function> functions;
+    std::unordered_map<std::string, StructDecl*> structs;
+    std::unordered_set<std::string> memberNames, leakingStructs;
+
+    // Bodies that change the result once they are parsed
+    std::unordered_set<const StatementList*> pending;
+    size_t kept{};
+
+    mutable std::mutex mutex;
+};
@@ -0,0 +1,138 @@
+#pragma once
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Fiber.hpp"
+
+// Runs the coroutines of async functions and the I/O they wait for
+// Every thread has its own loop, a coroutine is a fiber that always runs on the thread that started it
+class EventLoop
+{
+public:
+    struct Coroutine;
+
+    // An async call, a read, a write or a timer that can be awaited
+    struct Task
+    {
+        bool done{};
+        ValuePtr result;
+        std::exception_ptr error;
+
+        const EventLoop* loop{};
+        std::vector<Coroutine*> waiting;
+    };
+
+    using TaskPtr = std::shared_ptr<Task>;
+    using Body = std::function<ValuePtr()>;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // The loop bound on this thread, or the thread's own one
+    static EventLoop& Get();
+
+    // Makes a loop the one Get returns on this thread, until the binding ends
+    class Binding
+    {
+    public:
+        explicit Binding(EventLoop& loop)
+            : previous(std::exchange(bound, &loop))
+        {}
+
+        ~Binding()
+        {
+            bound = previous;
+        }
+
+        Binding(const Binding&) = delete;
+        Binding& operator=(const Binding&) = delete;
+
+    private:
+        EventLoop* previous;
+    };
+
+    // The coroutine starts when the loop gets to it, so several calls run at once
+    TaskPtr Start(Body body);
+
+    // Reads up to size bytes, an empty string means the end of the file
+    TaskPtr Read(int fd, size_t size);
+    TaskPtr Write(int fd, std::string data);
+    TaskPtr Sleep(std::chrono::milliseconds duration);
+
+    // Suspends the current coroutine until the task is done, outside of coroutines the loop runs meanwhile
+    ValuePtr Await(const TaskPtr& task);
+
+    // Runs until every coroutine is finished or waits for a task that can't finish anymore
+    void Run();
+
+    // Unwinds the coroutines that are left and drops the pending operations
+    void Cancel();
+
+private:
+    // Writes to closed pipes and sockets fail with EPIPE, without the signal that ends the process
+    enum class Descriptor
+    {
+        File, Pipe, Socket
+    };
+
+    struct Operation
+    {
+        TaskPtr task;
+        std::string data;
+        size_t size{};
+    };
+
+    struct Watch
+    {
+        std::deque<Operation> reads, writes;
+        uint32_t events{};
+        Descriptor descriptor{};
+    };
+
+    struct Timer
+    {
+        std::chrono::steady_clock::time_point deadline;
+        TaskPtr task;
+
+        bool operator>(const Timer& other) const { return deadline > other.deadline; }
+    };
+
+    // Runs until the task is done, or until nothing is left when there is no task
+    void RunUntil(const Task* task);
+
+    void Resume(Coroutine& coroutine);
+    void Suspend();
+    void Complete(Task& task);
+
+    // Regular files can't be watched, their operations are done right away
+    bool Watching(int fd, uint32_t events);
+    void Unwatch(int fd);
+    void Poll(int timeout);
+
+    // Returns whether the operation is finished, writes pass at most limit bytes at once
+    static bool Perform(Operation& operation, int fd, Descriptor descriptor, bool read, size_t limit);
+
+private:
+    int epoll{};
+
+    std::list<std::unique_ptr<Coroutine>> coroutines;
+    std::deque<Coroutine*> ready;
+    Coroutine* current{};
+
+    std::unordered_map<int, Watch> watches;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers;
+
+    static inline thread_local EventLoop* bound{};
+};
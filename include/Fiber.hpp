@@ -0,0 +1,68 @@
+#pragma once
+#include <exception>
+#include <functional>
+
+#include <ucontext.h>
+
+#include "AST/FrameRegion.hpp"
+
+// A function running on its own stack, so it can stop in the middle and continue later
+// Nodes are evaluated recursively, so suspending a script function means keeping its whole C++ stack
+// A fiber must be resumed on the thread that started it
+class Fiber
+{
+public:
+    // Thrown into a suspended fiber that is abandoned, so its stack unwinds
+    struct Cancelled {};
+
+    // Only touched pages take memory, so the stacks can be generous
+    static constexpr size_t defaultStackSize = 1024 * 1024;
+
+    // The function starts with the first Resume
+    explicit Fiber(std::function<void()> function, size_t stackSize = defaultStackSize);
+    ~Fiber();
+
+    Fiber(const Fiber&) = delete;
+    Fiber& operator=(const Fiber&) = delete;
+
+    // Runs the fiber until it suspends itself or its function returns, errors of the function are rethrown
+    void Resume();
+
+    // Only called on the fiber, returns to where it was resumed
+    // Throws Cancelled if the fiber was cancelled meanwhile
+    void Suspend();
+
+    // Resumes a suspended fiber for the last time, Suspend throws Cancelled in it
+    // Errors while the stack unwinds are dropped
+    void Cancel();
+
+    bool IsStarted() const;
+    bool IsFinished() const;
+
+    // The fiber running on this thread, nullptr on the thread's own stack
+    static Fiber* Current();
+
+private:
+    static void Entry();
+
+private:
+    void* stack;
+    size_t stackSize;
+    ucontext_t context{}, caller{};
+
+    // Frames of fibers end in a different order than the ones of the thread
+    FrameRegion region;
+
+    std::function<void()> function;
+    std::exception_ptr error;
+    bool started{}, finished{}, cancelled{};
+
+    Fiber* previous{};
+
+    // Only used by the address sanitizer
+    void* fakeStack{};
+    const void* callerStack{};
+    size_t callerStackSize{};
+
+    static thread_local Fiber* current;
+};
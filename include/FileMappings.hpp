@@ -0,0 +1,31 @@
+#pragma once
+#include <deque>
+#include <mutex>
+
+#include "AST/PackedArray.hpp"
+
+// Records of the files mmap_file mapped, kept apart from the heap so they don't count against its quota
+// Copies of a mapped array may outlive munmap_file, so the records stay until the interpreter ends
+// Every instance has its own, what is still mapped is released with it
+class FileMappings
+{
+public:
+    FileMappings() = default;
+    ~FileMappings();
+
+    FileMappings(const FileMappings&) = delete;
+    FileMappings& operator=(const FileMappings&) = delete;
+
+    // The record stays at the same address, arrays point to it
+    PackedArray::Mapping* Add(void* address, size_t length, size_t skipped);
+
+    // Later uses of the arrays throw, a mapping is only released once
+    void Release(PackedArray::Mapping& mapping);
+
+private:
+    std::mutex mutex;
+    std::deque<PackedArray::Mapping> mappings;
+};
+
+// The mappings of the interpreter running on this thread
+inline thread_local FileMappings* fileMappings{};
@@ -0,0 +1,33 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "Fiber.hpp"
+
+// Runs a generator function on its own fiber, every yield hands a value to the consumer and suspends the function
+// Values are passed by pointer, so they have to be copied before the generator is resumed again
+class Generator
+{
+public:
+    explicit Generator(std::function<void()> body);
+
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+
+    // Runs the function until its next yield, nullptr once it returned
+    const Value* Next();
+
+    // Called by the function, throws if it doesn't run in a generator
+    static void Yield(const Value& value);
+
+private:
+    Fiber fiber;
+    const Value* yielded{};
+
+    const std::thread::id thread = std::this_thread::get_id();
+
+    static thread_local Generator* running;
+};
+
+using GeneratorPtr = std::shared_ptr<Generator>;
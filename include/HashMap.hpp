@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+
+#include "AST/Value.hpp"
+
+// Backs the map built-in
+// A flat open-addressing table: one control byte per slot holds 7 bits of the hash,
+// so a group of 16 slots is probed with a single vector compare
+// Keys can be ints, chars, pointers or strings
+class HashMap
+{
+public:
+    HashMap() = default;
+    ~HashMap() = default;
+
+    Value* Find(const Value& key);
+
+    // Returns the value of the key, default initialized if the key is new
+    Value& Insert(const Value& key);
+    bool Erase(const Value& key);
+    void Clear();
+    void Reserve(size_t size);
+
+    size_t Size() const { return size; }
+    size_t Capacity() const { return capacity; }
+
+    // Slots are iterated in table order, -1 is returned after the last one
+    int64_t Next(int64_t slot) const;
+    const Value& KeyAt(size_t slot) const;
+    Value& ValueAt(size_t slot);
+
+private:
+    struct Slot
+    {
+        Value key;
+        Value value;
+    };
+
+    static constexpr size_t groupSize = 16;
+
+    static constexpr int8_t empty = -128;
+    static constexpr int8_t deleted = -2;
+
+    static size_t Hash(const Value& key);
+    static bool Equal(const Value& left, const Value& right);
+
+    // Bit i is set when control byte i of the group equals the byte
+    static uint32_t Match(const int8_t* group, int8_t byte);
+
+    int64_t FindSlot(const Value& key, size_t hash) const;
+    size_t FindInsertSlot(size_t hash) const;
+    void Rehash(size_t newCapacity);
+
+    void CheckSlot(size_t slot) const;
+
+private:
+    std::unique_ptr<int8_t[]> control;
+    std::unique_ptr<Slot[]> slots;
+
+    size_t capacity{};
+    size_t size{};
+    size_t tombstones{};
+};
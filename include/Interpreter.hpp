@@ -0,0 +1,97 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+#include "Allocator.hpp"
+#include "Budget.hpp"
+#include "Context.hpp"
+#include "EscapeAnalysis.hpp"
+#include "EventLoop.hpp"
+#include "FileMappings.hpp"
+#include "Fiber.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+
+// Runs one program with its own global scope, built-ins, heap and parsed nodes
+// Instances share no mutable state, so independent programs can run on different threads
+// An instance must only be used by one thread at a time
+class Interpreter
+{
+public:
+    Interpreter();
+    ~Interpreter();
+
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+
+    // Parses the program and initializes its global variables
+    Parser::RemovedCount Load(const std::filesystem::path& path);
+    void Restore(const std::filesystem::path& snapshotPath);
+    void Save(const std::filesystem::path& snapshotPath);
+
+    // Functions are analyzed once they are first called, so more instances are kept in frames as the program runs
+    void AnalyzeEscapes();
+
+    // Returns the number of constructors, whose instances are kept in frames so far
+    size_t GetKeptInFrames() const;
+
+    // Running out of fuel stops the program with BudgetExceeded
+    ValuePtr Run();
+
+    // Runs the program until it returns or has spent the fuel, empty when it paused
+    // The next call continues where it paused, so a host can time-slice programs on one thread
+    // Fuel borrowed by other threads or fibers of the program is paid back from the next slice
+    std::optional<ValuePtr> RunFor(int64_t fuel);
+
+    Allocator& GetHeap();
+
+    // Fuel of Run, RunFor sets it to the slice it is given
+    Budget& GetBudget();
+
+    // Most threads a parfor loop uses, 0 means one per core and 1 runs loops in order
+    void SetParallelism(size_t threads);
+
+private:
+    struct Binding
+    {
+        Context::Binding context;
+        EventLoop::Binding loop;
+    };
+
+    // Points the thread-local state used by the nodes and built-ins at this instance
+    Binding Bind();
+
+    ValuePtr RunMain();
+
+private:
+    // Declared first, so the nodes are released after everything that points to them
+    std::pmr::monotonic_buffer_resource nodes;
+    Allocator allocator;
+    FileMappings mappings;
+    Budget budget;
+
+    // Tasks started by spawn that are still running, they use everything below
+    std::shared_ptr<std::atomic<size_t>> tasks = std::make_shared<std::atomic<size_t>>();
+
+    // Every instance has its own coroutines, so paused programs don't run each other's
+    EventLoop events;
+
+    // The parser reports the bodies it parses to it, so it outlives the parser
+    std::optional<EscapeAnalysis> escapeAnalysis;
+
+    std::optional<Lexer> lexer;
+    std::optional<Parser> parser;
+
+    ScopePtr globals;
+    ScopePtr programScope;
+
+    size_t parallelism{};
+
+    // The program started by RunFor, the stack is as large as a thread's so recursion goes as deep
+    std::unique_ptr<Fiber> program;
+    ValuePtr programResult;
+
+    static constexpr size_t programStackSize = 8 * 1024 * 1024;
+};
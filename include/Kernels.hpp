@@ -0,0 +1,18 @@
+#pragma once
+#include "AST/Value.hpp"
+
+// Bulk operations on packed arrays, used by the numeric built-ins
+// Vectorized for AVX2 or the baseline instruction set, picked when the program starts
+namespace Kernels
+{
+
+Value Sum(const PackedArray& array);
+Value Min(const PackedArray& array);
+Value Max(const PackedArray& array);
+Value Dot(const PackedArray& left, const PackedArray& right);
+
+void Scale(const PackedArray& array, const Value& factor);
+void Add(const PackedArray& target, const PackedArray& source);
+void Fill(const PackedArray& array, const Value& value);
+
+}
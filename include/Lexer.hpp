@@ -1,6 +1,8 @@
 #pragma once
+#include <array>
 #include <filesystem>
 #include <map>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -11,6 +13,7 @@ using std::operator ""sv;
 
 // Not really the single responsibility class
 // It loads and preprocesses the code (finds, loads and inserts imported files)
+// Tokens are produced on demand, so only a few of them are kept in memory
 class Lexer
 {
 public:
@@ -29,21 +32,44 @@ public:
     };
 
     using Token = std::pair<TokenType, std::string>;
-    using TokenIter = std::vector<Token>::iterator;
     using StringIter = std::string::const_iterator;
 
+    // The code of a file, shared with the locations that point into it
+    struct Source
+    {
+        std::string code;
+        std::filesystem::path directory;
+    };
+
+    // Where a token starts, so a part of the code can be lexed again later without keeping its tokens
+    struct Location
+    {
+        std::shared_ptr<const Source> source;
+        size_t offset{};
+    };
+
     explicit Lexer(const std::filesystem::path& path);
     ~Lexer() = default;
 
     Token NextToken();
 
+    // Location of the token NextToken returned last
+    Location GetLocation() const;
+
+    // Lexes the code from begin up to the end offset before the rest of the stream, until EndReplay
+    void Replay(const Location& begin, size_t end);
+    void EndReplay();
+
 private:
-    void Tokenize();
+    Lexer(const Location& begin, size_t end);
+
+    void Fill();
+    Token Tokenize(Location& location);
 
-    Token ProcessIdentifier(StringIter& iter) const;
+    static Token ProcessIdentifier(StringIter& iter);
     static Token ProcessNumber(StringIter& iter);
     static Token ProcessString(StringIter& iter);
-    Token ProcessOperator(const StringIter& iter);
+    Token ProcessOperator(StringIter& iter) const;
 
 private:
     static std::string LoadCode(const std::filesystem::path& path);
@@ -51,18 +77,28 @@ private:
     static char ProcessChar(StringIter& iter);
 
 private:
-    const std::vector<std::string_view> reservedWords =
+    static constexpr std::array reservedWords =
     {
         "var"sv, "fun"sv, "if"sv, "else"sv, "while"sv, "for"sv,
-        "return"sv, "break"sv, "continue"sv, "struct"sv, "import"sv
+        "return"sv, "break"sv, "continue"sv, "struct"sv, "import"sv, "parfor"sv,
+        "async"sv, "await"sv, "yield"sv
     };
 
+    static constexpr size_t bufferSize = 16;
+
 private:
-    const std::string code;
+    // Imports are relative to the directory of the source
+    const std::shared_ptr<const Source> source;
+    StringIter position, end;
 
     bool comment{}, importFilename{};
-    std::vector<Token> tokens;
-    TokenIter current;
+    std::unique_ptr<Lexer> importLexer, replayLexer;
+
+    std::array<Token, bufferSize> buffer;
+    std::array<Location, bufferSize> locations;
+    size_t head{}, count{};
+
+    Location location;
 };
 
 const static std::unordered_map<char, Lexer::Token> operatorTokensMap =
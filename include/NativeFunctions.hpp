@@ -1,17 +1,267 @@
 #pragma once
+#include <algorithm>
 #include <cstring>
-#include <iostream>
-#include <print>
+#include <functional>
+#include <limits>
+#include <numeric>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Allocator.hpp"
+#include "Context.hpp"
+#include "EventLoop.hpp"
+#include "FileMappings.hpp"
+#include "HashMap.hpp"
+#include "Kernels.hpp"
+#include "Output.hpp"
+#include "Reader.hpp"
+#include "Serializer.hpp"
+#include "ThreadPool.hpp"
 #include "AST/AST.hpp"
 
-inline std::any GetFromStruct(const ScopePtr& scope, const std::string& name)
+inline Value* GetPointer(const ValuePtr& value)
+{
+    return reinterpret_cast<Value*>(std::get<size_t>(*value));
+}
+
+inline const ReaderPtr& GetReader(const ValuePtr& value)
+{
+    return std::any_cast<const ReaderPtr&>(std::get<std::any>(*value));
+}
+
+inline size_t GetCount(const ValuePtr& value)
+{
+    const auto count = std::get<int>(*value);
+    if(count < 0)
+        throw std::runtime_error("Invalid element count");
+
+    return count;
+}
+
+// Strings and byte arrays (like mapped files) are searched and sliced the same way
+inline std::string_view GetText(const ValuePtr& value)
+{
+    if(const auto array = std::get_if<PackedArray>(value.get()); array && array->type == PackedArray::Type::U8)
+        return { array->Data<char>(), array->size };
+
+    return std::get<String>(*value).View();
+}
+
+// Orders values of different types by their type, like memcmp orders bytes
+inline int CompareValues(const Value& left, const Value& right)
+{
+    if(left.index() != right.index())
+        return left.index() < right.index() ? -1 : 1;
+
+    return std::visit([&](auto&& l) -> int
+    {
+        using Type = std::decay_t<decltype(l)>;
+        const auto& r = std::get<Type>(right);
+
+        if constexpr (std::is_arithmetic_v<Type> || std::is_same_v<Type, String>)
+            return l < r ? -1 : r < l ? 1 : 0;
+        else if constexpr (std::is_same_v<Type, PackedArray>)
+            return l == r ? 0 : std::less<>()(l.data, r.data) ? -1 : 1;
+        else
+            throw std::runtime_error("Structure instances can't be compared");
+    }, left);
+}
+
+// serialize(value) or serialize(ptr, count) for buffers made by alloc
+inline std::string SerializeArgs(const std::vector<ValuePtr>::const_iterator begin,
+                                 const std::vector<ValuePtr>::const_iterator end)
+{
+    if(begin == end)
+        throw std::runtime_error("Not enough arguments");
+
+    Serializer serializer;
+
+    if(std::holds_alternative<size_t>(**begin) && end - begin > 1)
+        return serializer.Save(GetPointer(*begin), GetCount(*(begin + 1)));
+
+    return serializer.Save(**begin);
+}
+
+// A function started by spawn, the value of its handle holds it as std::any
+struct SpawnedTask
+{
+    std::atomic<bool> done{};
+    ValuePtr result;
+    std::exception_ptr error;
+};
+
+using SpawnedTaskPtr = std::shared_ptr<SpawnedTask>;
+
+// Atomic built-ins take a pointer, an optional index and then their operands
+inline std::atomic_ref<int> GetAtomicCell(const std::vector<ValuePtr>& args, const size_t operands)
+{
+    if(args.size() < operands + 1)
+        throw std::runtime_error("Not enough arguments");
+
+    auto cell = GetPointer(args[0]);
+    if(args.size() > operands + 1)
+        cell += GetCount(args[1]);
+
+    if(!std::holds_alternative<int>(*cell))
+        throw std::runtime_error("Atomic operations need an int cell");
+
+    return std::atomic_ref(std::get<int>(*cell));
+}
+
+// A script function that built-ins call for every element, named by a string like with spawn
+class ScriptFunction
+{
+public:
+    ScriptFunction(const ValuePtr& name, const ScopePtr& scope)
+        : name(std::get<String>(*name).View()), scope(scope)
+    {
+        if(!scope->Contains(this->name))
+            throw std::runtime_error(std::format("Function '{}' not found", this->name));
+
+        function = scope->Get(this->name);
+        if(!dynamic_cast<StatementList*>(function.get()))
+            throw std::runtime_error(std::format("'{}' is not a function", this->name));
+    }
+
+    // Can be called from several threads, as long as the context of the interpreter is bound
+    template<typename... Args>
+    Value operator()(const Args&... args) const
+    {
+        const FrameRegion::Frame frame;
+        const auto localScope = MakeFrameScope(scope);
+        const std::pmr::polymorphic_allocator<> allocator(localScope->GetResource());
+
+        const std::vector<ExprPtr> passed{
+            std::allocate_shared<ValueExpr>(allocator, std::allocate_shared<Value>(allocator, args))...
+        };
+
+        ValuePtr result;
+
+        try
+        {
+            result = static_cast<StatementList&>(*function).Call(localScope, passed, false);
+        }
+        catch(const ReturnExpr::ReturnValue& returnValue)
+        {
+            result = returnValue.value;
+        }
+
+        if(!result)
+            throw std::runtime_error(std::format("'{}' returned nothing", name));
+
+        return *result;
+    }
+
+private:
+    std::string name;
+    ScopePtr scope;
+    ExprPtr function;
+};
+
+// Element counts of the parts that the bulk built-ins split buffers into
+// The parts only depend on the element count, so results don't change with the number of threads
+constexpr size_t nativePartSize = 1 << 14;
+constexpr size_t callbackPartSize = 256;
+
+// Calls body(part) for every part on the thread pool, with the interpreter of the calling thread bound
+inline void ForEachPart(const size_t parts, const std::function<void(size_t)>& body)
+{
+    if(parts == 1)
+    {
+        body(0);
+        return;
+    }
+
+    auto& pool = ThreadPool::Get();
+
+    pool.For(0, static_cast<int64_t>(parts), parallelism ? parallelism : pool.GetThreadCount(),
+        [&, context = Context::Current()](const ThreadPool::NextChunk& next)
+        {
+            const Context::Binding binding(context);
+
+            for(int64_t part, last; next(part, last);)
+                for(; part < last; part++)
+                    body(part);
+        });
+}
+
+// Merges the sorted index runs [from, middle) and [middle, to) through the scratch buffer
+// Both runs are walked with explicit bounds, so an inconsistent comparator gives an unsorted result but stays inside them
+template<typename Less>
+void MergeIndices(const Value* data, size_t* order, size_t* scratch, const size_t from, const size_t middle, const size_t to, const Less& less)
+{
+    auto left = from, right = middle, out = from;
+    while(left < middle && right < to)
+        scratch[out++] = less(data[order[right]], data[order[left]]) ? order[right++] : order[left++];
+
+    std::copy(order + left, order + middle, scratch + out);
+    std::copy(order + right, order + to, scratch + out + (middle - left));
+    std::copy(scratch + from, scratch + to, order + from);
+}
+
+// Sorts the indices of the parts in parallel, then merges neighbours in rounds, every merge of a round in parallel
+// The elements are only moved once the comparator is done, so when it throws the buffer is left as it was
+template<typename Less>
+void SortValues(Value* data, const size_t count, const size_t partSize, const Less& less)
+{
+    const auto parts = (count + partSize - 1) / partSize;
+    const auto bound = [&](const size_t part) { return std::min(count, part * partSize); };
+
+    std::vector<size_t> order(count), scratch(count);
+    std::iota(order.begin(), order.end(), size_t{});
+
+    ForEachPart(parts, [&](const size_t part)
+    {
+        const auto from = bound(part), to = bound(part + 1);
+
+        for(size_t width = 1; width < to - from; width *= 2)
+            for(auto first = from; first + width < to; first += 2 * width)
+                MergeIndices(data, order.data(), scratch.data(), first, first + width, std::min(to, first + 2 * width), less);
+    });
+
+    for(size_t width = 1; width < parts; width *= 2)
+        ForEachPart((parts + 2 * width - 1) / (2 * width), [&](const size_t pair)
+        {
+            const auto first = pair * 2 * width;
+            MergeIndices(data, order.data(), scratch.data(), bound(first), bound(first + width), bound(first + 2 * width), less);
+        });
+
+    std::vector<Value> sorted;
+    sorted.reserve(count);
+
+    for(const auto i : order)
+        sorted.push_back(std::move(data[i]));
+
+    std::ranges::move(sorted, data);
+}
+
+// Folds every part from its first element, then folds init with the part results in order
+// The operation has to be associative, init only appears once
+template<typename Combine>
+Value ReduceValues(const Value* data, const size_t count, const size_t partSize, Value init, const Combine& combine)
 {
-    const auto evaluated = *scope->Get("this")->Evaluate(scope);
-    const auto self = std::any_cast<StructInstancePtr>(std::get<std::any>(evaluated));
-    const auto data = *self->localScope->Get(name)->Evaluate({});
+    const auto parts = (count + partSize - 1) / partSize;
+    std::vector<Value> results(parts);
 
-    return std::get<std::any>(*std::any_cast<ValuePtr>(std::get<std::any>(data)));
+    ForEachPart(parts, [&](const size_t part)
+    {
+        const auto end = data + std::min(count, (part + 1) * partSize);
+        auto it = data + part * partSize;
+
+        Value result = *it;
+        while(++it != end)
+            result = combine(result, *it);
+
+        results[part] = std::move(result);
+    });
+
+    for(const auto& result : results)
+        init = combine(init, result);
+
+    return init;
 }
 
 inline void DeclareDefaultFunctions()
@@ -19,14 +269,63 @@ inline void DeclareDefaultFunctions()
     // Functions
     globalScope->Declare("print", std::make_shared<UndefinedExpr>());
     globalScope->Declare("println", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("flush", std::make_shared<UndefinedExpr>());
     globalScope->Declare("input", std::make_shared<UndefinedExpr>());
     globalScope->Declare("alloc", std::make_shared<UndefinedExpr>());
     globalScope->Declare("realloc", std::make_shared<UndefinedExpr>());
     globalScope->Declare("free", std::make_shared<UndefinedExpr>());
     globalScope->Declare("assert", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("memcpy", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("memmove", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("memset", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("memcmp", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("spawn", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("join", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("atomic_add", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("cas", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("sort", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("sort_by", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("reduce", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("transform", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("open_file", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("close_file", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("pipe", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("read_async", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("write_async", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("sleep_async", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("mmap_file", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("munmap_file", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("file_size", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("reader", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("read_line", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("read_chunk", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("read_all", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("eof", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("serialize", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("serialize_to", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("deserialize", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("deserialize_from", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("len", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("concat", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("slice", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("find", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("compare", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("alloc_i32", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("alloc_i64", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("alloc_f32", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("alloc_f64", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("alloc_u8", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("packed_sum", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("packed_min", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("packed_max", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("packed_dot", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("packed_scale", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("packed_add", std::make_shared<UndefinedExpr>());
+    globalScope->Declare("packed_fill", std::make_shared<UndefinedExpr>());
 
     // Structures
     globalScope->Declare("array", std::make_shared<StructDecl>("array"));
+    globalScope->Declare("map", std::make_shared<StructDecl>("map"));
 }
 
 inline void DefineDefaultFunctions()
@@ -35,15 +334,7 @@ inline void DefineDefaultFunctions()
         std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
         {
             for(const auto& arg : args)
-                std::visit([](auto&& v)
-                {
-                    if constexpr (std::is_same_v<std::decay_t<decltype(v)>, size_t>)
-                        std::print("{}", reinterpret_cast<const char*>(v));
-                    else if constexpr (!std::is_same_v<std::decay_t<decltype(v)>, std::any>)
-                        std::print("{}", v);
-                    else
-                        std::print("Non printable");
-                }, *arg);
+                console.WriteValue(*arg);
 
             return nullptr;
         });
@@ -52,35 +343,25 @@ inline void DefineDefaultFunctions()
         std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
         {
             for(const auto& arg : args)
-                std::visit([](auto&& v)
-                {
-                    if constexpr (std::is_same_v<std::decay_t<decltype(v)>, size_t>)
-                    {
-                        auto pos = v;
-                        while(*reinterpret_cast<char*>(pos) != '\0')
-                        {
-                            std::print("{}", *reinterpret_cast<char*>(pos));
-                            pos += sizeof(Value);
-                        }
-                    }
-                    else if constexpr (!std::is_same_v<std::decay_t<decltype(v)>, std::any>)
-                        std::print("{}", v);
-                    else
-                        std::print("Non printable");
-                }, *arg);
+                console.WriteValue(*arg);
 
-            std::println("");
+            console.EndLine();
 
             return nullptr;
         });
 
-    globalScope->Get("input") =
+    globalScope->Get("flush") =
         std::make_shared<StatementList>([](const auto&, const auto&) -> ValuePtr
         {
-            std::string input;
-            std::getline(std::cin, input);
+            console.Flush();
+
+            return nullptr;
+        });
 
-            return std::make_shared<Value>(input);
+    globalScope->Get("input") =
+        std::make_shared<StatementList>([](const auto&, const auto&) -> ValuePtr
+        {
+            return std::make_shared<Value>(Reader::Stdin()->ReadLine());
         });
 
     globalScope->Get("alloc") =
@@ -93,12 +374,11 @@ inline void DefineDefaultFunctions()
             if(size <= 0)
                 throw std::runtime_error("Invalid allocation size");
 
-            auto ptr = static_cast<Value*>(calloc(size, sizeof(Value)));
+            auto ptr = static_cast<Value*>(heap->Allocate(size * sizeof(Value)));
             if(!ptr)
                 throw std::runtime_error("Memory allocation failed");
 
-            for(int i = 0; i < size; i++)
-                new (&ptr[i]) Value(0);
+            std::uninitialized_fill_n(ptr, size, Value(0));
 
             return std::make_shared<Value>(reinterpret_cast<size_t>(ptr));
         });
@@ -117,12 +397,12 @@ inline void DefineDefaultFunctions()
             if(size <= 0)
                 throw std::runtime_error("Invalid reallocation size");
 
-            auto ret = static_cast<Value*>(realloc(ptr, size * sizeof(Value)));
+            auto ret = static_cast<Value*>(heap->Reallocate(ptr, size * sizeof(Value)));
             if(!ret)
                 throw std::runtime_error("Memory reallocation failed");
 
-            for(int i = oldSize; i < size; i++)
-                new (&ret[i]) Value(0);
+            if(oldSize < size)
+                std::uninitialized_fill_n(ret + oldSize, size - oldSize, Value(0));
 
             return std::make_shared<Value>(reinterpret_cast<size_t>(ret));
         });
@@ -133,7 +413,15 @@ inline void DefineDefaultFunctions()
             if(args.empty())
                 throw std::runtime_error("Not enough arguments");
 
-            free(reinterpret_cast<void*>(std::get<size_t>(*args[0])));
+            if(const auto array = std::get_if<PackedArray>(args[0].get()))
+            {
+                if(array->origin != PackedArray::Origin::Heap)
+                    throw std::runtime_error("Mapped files are released with munmap_file");
+
+                heap->Free(array->data);
+            }
+            else
+                heap->Free(reinterpret_cast<void*>(std::get<size_t>(*args[0])));
 
             return nullptr;
         });
@@ -150,44 +438,977 @@ inline void DefineDefaultFunctions()
             return nullptr;
         });
 
-    using ArrayPtr = std::shared_ptr<std::vector<ValuePtr>>;
+    // The bulk memory built-ins work on elements, not bytes
+    globalScope->Get("memcpy") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 3)
+                throw std::runtime_error("Not enough arguments");
+
+            const auto destination = GetPointer(args[0]);
+            const auto count = GetCount(args[2]);
 
-    auto vec = std::make_shared<std::vector<ValuePtr>>();
+            // Strings are copied one character per element, including the terminator
+            if(const auto string = std::get_if<String>(args[1].get()))
+            {
+                for(size_t i = 0; i < count; i++)
+                    destination[i] = string->At(i);
+            }
+            else
+                std::copy_n(GetPointer(args[1]), count, destination);
 
-    auto array = std::make_shared<StructDecl>("array");
-    array->content["data"] = std::make_shared<VariableDecl>("data", std::make_shared<ValueExpr>(std::move(vec)));
-    array->content["at"] = std::make_shared<FunctionDecl>("at", std::make_shared<StatementList>(
-            [&](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+            return args[0];
+        });
+
+    globalScope->Get("memmove") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 3)
+                throw std::runtime_error("Not enough arguments");
+
+            const auto destination = GetPointer(args[0]);
+            const auto source = GetPointer(args[1]);
+            const auto count = GetCount(args[2]);
+
+            if(destination < source)
+                std::copy(source, source + count, destination);
+            else
+                std::copy_backward(source, source + count, destination + count);
+
+            return args[0];
+        });
+
+    globalScope->Get("memset") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 3)
+                throw std::runtime_error("Not enough arguments");
+
+            std::fill_n(GetPointer(args[0]), GetCount(args[2]), *args[1]);
+
+            return args[0];
+        });
+
+    globalScope->Get("memcmp") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 3)
+                throw std::runtime_error("Not enough arguments");
+
+            const auto left = GetPointer(args[0]);
+            const auto right = GetPointer(args[1]);
+            const auto count = GetCount(args[2]);
+
+            for(size_t i = 0; i < count; i++)
+                if(const auto order = CompareValues(left[i], right[i]))
+                    return std::make_shared<Value>(order);
+
+            return std::make_shared<Value>(0);
+        });
+
+    // spawn("name", args...) calls the function on the thread pool, join(handle) waits for its result
+    // Tasks nobody joins still finish before the program ends
+    globalScope->Get("spawn") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            const auto name = std::string(std::get<String>(*args[0]).View());
+
+            if(!scope->Contains(name))
+                throw std::runtime_error(std::format("Function '{}' not found", name));
+
+            const auto function = scope->Get(name);
+            if(!dynamic_cast<StatementList*>(function.get()))
+                throw std::runtime_error(std::format("'{}' is not a function", name));
+
+            // Arguments are copied, only pointers share memory with the task
+            std::vector<ExprPtr> passed;
+            for(const auto& arg : args | std::views::drop(1))
+                passed.push_back(std::make_shared<ValueExpr>(arg));
+
+            // The caller's frame might be gone when the task starts, so it runs in a scope on the heap
+            auto body = FunctionCall::Detach(function, FindDetachedOwner(scope, name), passed, scope);
+            auto task = std::make_shared<SpawnedTask>();
+
+            // Whatever was printed before goes out before the output of the task
+            console.Flush();
+
+            spawnedTasks->fetch_add(1, std::memory_order_relaxed);
+
+            ThreadPool::Get().Submit([task, body = std::move(body), context = Context::Current()]() mutable
+            {
+                {
+                    const Context::Binding binding(context);
+
+                    // Whoever runs the job may be joining from another loop, even another interpreter's,
+                    // so the coroutines of the task get a loop of their own
+                    EventLoop events;
+                    const EventLoop::Binding loop(events);
+
+                    try
+                    {
+                        task->result = body();
+
+                        // Coroutines that nobody awaited still finish
+                        events.Run();
+                    }
+                    catch(...)
+                    {
+                        task->error = std::current_exception();
+                    }
+
+                    events.Cancel();
+                    console.Flush();
+
+                    task->done.store(true, std::memory_order_release);
+                    task->done.notify_all();
+
+                    // Values and scopes of the interpreter are released while it waits for the task
+                    task.reset();
+                    body = nullptr;
+                }
+
+                const auto tasks = std::move(context.tasks);
+                context = {};
+
+                if(tasks->fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    tasks->notify_all();
+            });
+
+            return std::make_shared<Value>(std::any(std::move(task)));
+        });
+
+    globalScope->Get("join") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            const auto task = std::any_cast<SpawnedTaskPtr>(std::get<std::any>(*args[0]));
+
+            // The joining thread runs other tasks meanwhile, so nested joins don't starve the pool
+            ThreadPool::Get().Wait(task->done);
+
+            if(task->error)
+                std::rethrow_exception(task->error);
+
+            return task->result;
+        });
+
+    // atomic_add(ptr, [index,] value) returns the previous value
+    globalScope->Get("atomic_add") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            const auto cell = GetAtomicCell(args, 1);
+
+            return std::make_shared<Value>(cell.fetch_add(std::get<int>(*args.back())));
+        });
+
+    // cas(ptr, [index,] expected, desired) returns whether the value was replaced
+    globalScope->Get("cas") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            const auto cell = GetAtomicCell(args, 2);
+            auto expected = std::get<int>(*args[args.size() - 2]);
+
+            return std::make_shared<Value>(cell.compare_exchange_strong(expected, std::get<int>(*args.back())));
+        });
+
+    // The bulk built-ins split large buffers into parts that run on the thread pool
+    globalScope->Get("sort") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            SortValues(GetPointer(args[0]), GetCount(args[1]), nativePartSize, [](const Value& left, const Value& right)
             {
-                if(args.empty())
-                    throw std::runtime_error("Not enough arguments");
+                return CompareValues(left, right) < 0;
+            });
 
-                const auto arr = std::any_cast<ArrayPtr>(GetFromStruct(scope, "data"));
+            return args[0];
+        });
+
+    // sort_by(ptr, n, "less") takes a function that returns true or a negative number when its first argument goes first
+    globalScope->Get("sort_by") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+        {
+            if(args.size() < 3)
+                throw std::runtime_error("Not enough arguments");
+
+            const ScriptFunction less(args[2], scope);
 
-                return arr->at(std::get<int>(*args[0]));
-            }));
-    array->content["add"] =
-        std::make_shared<FunctionDecl>("add", std::make_shared<StatementList>(
-            [&](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+            SortValues(GetPointer(args[0]), GetCount(args[1]), callbackPartSize, [&less](const Value& left, const Value& right)
             {
-                if(args.empty())
-                    throw std::runtime_error("Not enough arguments");
+                const auto order = less(left, right);
+                if(const auto result = std::get_if<bool>(&order))
+                    return *result;
+
+                return std::get<int>(order) < 0;
+            });
+
+            return args[0];
+        });
 
-                const auto arr = std::any_cast<ArrayPtr>(GetFromStruct(scope, "data"));
+    // reduce(ptr, n[, init]) adds the elements, reduce(ptr, n, "f", init) combines them with an associative function
+    globalScope->Get("reduce") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
 
-                for(const auto& arg : args)
-                    arr->push_back(std::make_shared<Value>(*arg));
+            const auto data = GetPointer(args[0]);
+            const auto count = GetCount(args[1]);
 
-                return nullptr;
-            }));
-    array->content["size"] =
-        std::make_shared<FunctionDecl>("size", std::make_shared<StatementList>(
-            [&](const auto&, const ScopePtr& scope) -> ValuePtr
+            if(args.size() < 4)
             {
-                const auto arr = std::any_cast<ArrayPtr>(GetFromStruct(scope, "data"));
+                using namespace ValueOp;
 
-                return std::make_shared<Value>(static_cast<int>(arr->size()));
-            }));
+                return std::make_shared<Value>(ReduceValues(data, count, nativePartSize, args.size() > 2 ? *args[2] : Value(0),
+                    [](const Value& left, const Value& right) { return left + right; }));
+            }
 
-    globalScope->Get("array") = std::move(array);
+            const ScriptFunction combine(args[2], scope);
+
+            return std::make_shared<Value>(ReduceValues(data, count, callbackPartSize, *args[3], combine));
+        });
+
+    // transform(dst, src, n, "f") stores f(src[i]) into dst[i], the buffers may be the same
+    globalScope->Get("transform") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+        {
+            if(args.size() < 4)
+                throw std::runtime_error("Not enough arguments");
+
+            const auto destination = GetPointer(args[0]);
+            const auto source = GetPointer(args[1]);
+            const auto count = GetCount(args[2]);
+            const ScriptFunction function(args[3], scope);
+
+            ForEachPart((count + callbackPartSize - 1) / callbackPartSize, [&](const size_t part)
+            {
+                for(auto i = part * callbackPartSize; i < std::min(count, (part + 1) * callbackPartSize); i++)
+                    destination[i] = function(source[i]);
+            });
+
+            return args[0];
+        });
+
+    // open_file(path, mode) returns a descriptor, the modes are "r", "w", "a" and "rw"
+    globalScope->Get("open_file") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            const std::string path(std::get<String>(*args[0]).View());
+            const auto mode = std::get<String>(*args[1]).View();
+
+            int flags;
+            if(mode == "r")
+                flags = O_RDONLY;
+            else if(mode == "w")
+                flags = O_WRONLY | O_CREAT | O_TRUNC;
+            else if(mode == "a")
+                flags = O_WRONLY | O_CREAT | O_APPEND;
+            else if(mode == "rw")
+                flags = O_RDWR | O_CREAT;
+            else
+                throw std::runtime_error(std::format("Invalid file mode '{}'", mode));
+
+            const auto fd = open(path.c_str(), flags | O_CLOEXEC, 0644);
+            if(fd < 0)
+                throw std::runtime_error(std::format("Can't open {}: {}", path, std::strerror(errno)));
+
+            return std::make_shared<Value>(fd);
+        });
+
+    globalScope->Get("close_file") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            close(std::get<int>(*args[0]));
+
+            return nullptr;
+        });
+
+    // pipe(ptr) stores the descriptor to read from in ptr[0] and the one to write to in ptr[1]
+    globalScope->Get("pipe") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            int fds[2];
+            if(pipe2(fds, O_CLOEXEC) < 0)
+                throw std::runtime_error(std::format("Can't create a pipe: {}", std::strerror(errno)));
+
+            const auto ends = GetPointer(args[0]);
+            ends[0] = fds[0];
+            ends[1] = fds[1];
+
+            return nullptr;
+        });
+
+    // The async I/O built-ins return tasks, await gives a string for reads, the amount of written bytes for writes
+    globalScope->Get("read_async") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            const auto size = std::get<int>(*args[1]);
+            if(size <= 0)
+                throw std::runtime_error("Invalid read size");
+
+            return std::make_shared<Value>(std::any(EventLoop::Get().Read(std::get<int>(*args[0]), size)));
+        });
+
+    globalScope->Get("write_async") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            // Whatever was printed before goes out first
+            console.Flush();
+
+            return std::make_shared<Value>(std::any(
+                EventLoop::Get().Write(std::get<int>(*args[0]), std::string(std::get<String>(*args[1]).View()))
+            ));
+        });
+
+    globalScope->Get("sleep_async") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(std::any(
+                EventLoop::Get().Sleep(std::chrono::milliseconds(std::get<int>(*args[0])))
+            ));
+        });
+
+    // mmap_file(path[, offset, length]) maps a file as a byte array without copying it
+    // The bytes are read-only, stores to them throw
+    // Indices are ints, so files over 2 GiB are mapped in windows, offsets may be doubles past that
+    globalScope->Get("mmap_file") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            const std::string path(std::get<String>(*args[0]).View());
+
+            const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0)
+                throw std::runtime_error(std::format("Can't open {}: {}", path, std::strerror(errno)));
+
+            struct stat info{};
+            if(fstat(fd, &info) < 0)
+            {
+                close(fd);
+                throw std::runtime_error(std::format("Can't stat {}: {}", path, std::strerror(errno)));
+            }
+
+            const auto fileSize = static_cast<uint64_t>(info.st_size);
+            const auto offset = args.size() > 1 ? ValueOp::ToNumber<int64_t>(*args[1]) : 0;
+            if(offset < 0)
+            {
+                close(fd);
+                throw std::runtime_error("Invalid mapping offset");
+            }
+
+            const auto available = fileSize > static_cast<uint64_t>(offset) ? fileSize - offset : 0;
+            const auto length = args.size() > 2 ? std::min<uint64_t>(GetCount(args[2]), available) : available;
+            if(length > std::numeric_limits<int>::max())
+            {
+                close(fd);
+                throw std::runtime_error(std::format("{} is too large to map at once, map it in windows", path));
+            }
+
+            PackedArray bytes{ nullptr, static_cast<uint32_t>(length), PackedArray::Type::U8, PackedArray::Origin::Mapped };
+            if(length == 0)
+            {
+                close(fd);
+                return std::make_shared<Value>(bytes);
+            }
+
+            // Mappings start on a page, the bytes before the offset are skipped
+            const auto skipped = static_cast<uint64_t>(offset) % sysconf(_SC_PAGESIZE);
+            const auto mapped = mmap(nullptr, length + skipped, PROT_READ, MAP_PRIVATE, fd, offset - skipped);
+            close(fd);
+
+            if(mapped == MAP_FAILED)
+                throw std::runtime_error(std::format("Can't map {}: {}", path, std::strerror(errno)));
+
+            madvise(mapped, length + skipped, MADV_SEQUENTIAL);
+
+            bytes.data = fileMappings->Add(mapped, length + skipped, skipped);
+
+            return std::make_shared<Value>(bytes);
+        });
+
+    globalScope->Get("munmap_file") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            const auto bytes = std::get<PackedArray>(*args[0]);
+            if(bytes.origin != PackedArray::Origin::Mapped)
+                throw std::runtime_error("munmap_file only releases mapped files, arrays are released with free");
+
+            // Empty files aren't mapped
+            if(const auto mapping = static_cast<PackedArray::Mapping*>(bytes.data))
+                fileMappings->Release(*mapping);
+
+            return nullptr;
+        });
+
+    // The size is a double, as large files don't fit an int
+    globalScope->Get("file_size") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            const std::string path(std::get<String>(*args[0]).View());
+
+            struct stat info{};
+            if(stat(path.c_str(), &info) < 0)
+                throw std::runtime_error(std::format("Can't stat {}: {}", path, std::strerror(errno)));
+
+            return std::make_shared<Value>(static_cast<double>(info.st_size));
+        });
+
+    // reader(fd) reads a descriptor in large blocks, reader(0) is stdin
+    globalScope->Get("reader") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            const auto fd = std::get<int>(*args[0]);
+            if(fd == STDIN_FILENO)
+                return std::make_shared<Value>(std::any(Reader::Stdin()));
+
+            return std::make_shared<Value>(std::any(std::make_shared<Reader>(fd)));
+        });
+
+    globalScope->Get("read_line") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(GetReader(args[0])->ReadLine());
+        });
+
+    globalScope->Get("read_chunk") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(GetReader(args[0])->ReadChunk(GetCount(args[1])));
+        });
+
+    globalScope->Get("read_all") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(GetReader(args[0])->ReadAll());
+        });
+
+    globalScope->Get("eof") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(GetReader(args[0])->Eof());
+        });
+
+    // serialize(value[, count]) returns the record as a string
+    globalScope->Get("serialize") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            return std::make_shared<Value>(String(SerializeArgs(args.begin(), args.end())));
+        });
+
+    // serialize_to(fd, value[, count]) writes the record straight to the descriptor
+    globalScope->Get("serialize_to") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            const auto fd = std::get<int>(*args[0]);
+            const auto record = SerializeArgs(args.begin() + 1, args.end());
+
+            for(size_t written = 0; written < record.size();)
+            {
+                const auto count = write(fd, record.data() + written, record.size() - written);
+                if(count < 0 && errno != EINTR)
+                    throw std::runtime_error(std::format("Write failed: {}", std::strerror(errno)));
+
+                if(count > 0)
+                    written += count;
+            }
+
+            return std::make_shared<Value>(static_cast<int>(record.size()));
+        });
+
+    // deserialize(record) takes a string or a byte array, like a mapped file
+    globalScope->Get("deserialize") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(Serializer().Load(GetText(args[0]), scope));
+        });
+
+    // deserialize_from(reader) reads the next record, eof(reader) tells when there are no more
+    globalScope->Get("deserialize_from") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            const auto& reader = GetReader(args[0]);
+            const auto header = reader->ReadExact(Serializer::headerSize);
+            const auto body = reader->ReadExact(Serializer::BodySize(header.View()));
+
+            return std::make_shared<Value>(Serializer().LoadBody(body.View(), scope));
+        });
+
+    globalScope->Get("len") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            if(const auto array = std::get_if<PackedArray>(args[0].get()))
+                return std::make_shared<Value>(static_cast<int>(array->size));
+
+            return std::make_shared<Value>(static_cast<int>(std::get<String>(*args[0]).Size()));
+        });
+
+    globalScope->Get("concat") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(
+                String::Concat(std::get<String>(*args[0]).View(), std::get<String>(*args[1]).View())
+            );
+        });
+
+    globalScope->Get("slice") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 3)
+                throw std::runtime_error("Not enough arguments");
+
+            const auto begin = std::get<int>(*args[1]);
+            const auto end = std::get<int>(*args[2]);
+
+            if(begin < 0 || end < 0)
+                throw std::runtime_error("Invalid string slice");
+
+            if(const auto string = std::get_if<String>(args[0].get()))
+                return std::make_shared<Value>(string->Slice(begin, end));
+
+            // Slices of byte arrays are copied into a string
+            const auto text = GetText(args[0]);
+            if(begin > end || static_cast<size_t>(end) > text.size())
+                throw std::runtime_error("Invalid string slice");
+
+            return std::make_shared<Value>(String(text.substr(begin, end - begin)));
+        });
+
+    // find(text, pattern[, from]) searches strings and byte arrays
+    globalScope->Get("find") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            const auto from = args.size() > 2 ? GetCount(args[2]) : 0;
+            const auto position = GetText(args[0]).find(std::get<String>(*args[1]).View(), from);
+
+            return std::make_shared<Value>(position == std::string_view::npos ? -1 : static_cast<int>(position));
+        });
+
+    globalScope->Get("compare") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            const auto order = std::get<String>(*args[0]) <=> std::get<String>(*args[1]);
+
+            return std::make_shared<Value>(order < 0 ? -1 : order > 0 ? 1 : 0);
+        });
+
+    const auto packedAlloc = [](const PackedArray::Type type)
+    {
+        return std::make_shared<StatementList>([type](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            const auto size = std::get<int>(*args[0]);
+            if(size <= 0)
+                throw std::runtime_error("Invalid allocation size");
+
+            PackedArray array{ nullptr, static_cast<uint32_t>(size), type };
+
+            array.data = heap->Allocate(size * array.ElementSize());
+            if(!array.data)
+                throw std::runtime_error("Memory allocation failed");
+
+            std::memset(array.data, 0, size * array.ElementSize());
+
+            return std::make_shared<Value>(array);
+        });
+    };
+
+    globalScope->Get("alloc_i32") = packedAlloc(PackedArray::Type::I32);
+    globalScope->Get("alloc_i64") = packedAlloc(PackedArray::Type::I64);
+    globalScope->Get("alloc_f32") = packedAlloc(PackedArray::Type::F32);
+    globalScope->Get("alloc_f64") = packedAlloc(PackedArray::Type::F64);
+    globalScope->Get("alloc_u8") = packedAlloc(PackedArray::Type::U8);
+
+    globalScope->Get("packed_sum") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(Kernels::Sum(std::get<PackedArray>(*args[0])));
+        });
+
+    globalScope->Get("packed_min") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(Kernels::Min(std::get<PackedArray>(*args[0])));
+        });
+
+    globalScope->Get("packed_max") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.empty())
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(Kernels::Max(std::get<PackedArray>(*args[0])));
+        });
+
+    globalScope->Get("packed_dot") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            return std::make_shared<Value>(
+                Kernels::Dot(std::get<PackedArray>(*args[0]), std::get<PackedArray>(*args[1]))
+            );
+        });
+
+    globalScope->Get("packed_scale") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            Kernels::Scale(std::get<PackedArray>(*args[0]), *args[1]);
+
+            return nullptr;
+        });
+
+    globalScope->Get("packed_add") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            Kernels::Add(std::get<PackedArray>(*args[0]), std::get<PackedArray>(*args[1]));
+
+            return nullptr;
+        });
+
+    globalScope->Get("packed_fill") =
+        std::make_shared<StatementList>([](const std::vector<ValuePtr>& args, const auto&) -> ValuePtr
+        {
+            if(args.size() < 2)
+                throw std::runtime_error("Not enough arguments");
+
+            Kernels::Fill(std::get<PackedArray>(*args[0]), *args[1]);
+
+            return nullptr;
+        });
+
+    // Native structures declare their methods once, every instance keeps its own elements in its state
+    const auto method = [](StructDecl& structDecl, const std::string& name, FunctionType&& function)
+    {
+        structDecl.content[name] = std::make_shared<FunctionDecl>(name, std::make_shared<StatementList>(std::move(function)));
+    };
+
+    using Elements = std::shared_ptr<std::vector<Value>>;
+
+    auto array = std::make_shared<StructDecl>("array");
+    array->nativeInit = [] { return std::any(std::make_shared<std::vector<Value>>()); };
+
+    // for-in goes over the elements, the size is checked on every step as the loop may change it
+    array->nativeNext = [](const std::any& state, size_t& position) -> const Value*
+    {
+        const auto& storage = std::any_cast<const Elements&>(state);
+
+        return position < storage->size() ? &(*storage)[position++] : nullptr;
+    };
+
+    const auto index = [](const std::vector<Value>& storage, const ValuePtr& value, const bool allowEnd)
+    {
+        const auto i = static_cast<size_t>(std::get<int>(*value));
+        if(i > storage.size() || (i == storage.size() && !allowEnd))
+            throw std::runtime_error("Index out of range");
+
+        return i;
+    };
+
+    method(*array, "add", [](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        const auto& storage = NativeState<Elements>(scope);
+
+        for(const auto& arg : args)
+            storage->push_back(*arg);
+
+        return nullptr;
+    });
+
+    // Assigning to the element stores it back at its index, which is checked again then
+    method(*array, "at", [index](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.empty())
+            throw std::runtime_error("Not enough arguments");
+
+        const auto& storage = NativeState<Elements>(scope);
+        const auto i = index(*storage, args[0], false);
+
+        return IndexExpr::Reference((*storage)[i], [weak = std::weak_ptr(storage), i](const Value& value)
+        {
+            const auto elements = weak.lock();
+            if(!elements || i >= elements->size())
+                throw std::runtime_error("Index out of range");
+
+            (*elements)[i] = value;
+        });
+    });
+
+    method(*array, "set", [index](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.size() < 2)
+            throw std::runtime_error("Not enough arguments");
+
+        auto& storage = *NativeState<Elements>(scope);
+        storage[index(storage, args[0], false)] = *args[1];
+
+        return nullptr;
+    });
+
+    method(*array, "insert", [index](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.size() < 2)
+            throw std::runtime_error("Not enough arguments");
+
+        auto& storage = *NativeState<Elements>(scope);
+        storage.insert(storage.begin() + index(storage, args[0], true), *args[1]);
+
+        return nullptr;
+    });
+
+    method(*array, "remove", [index](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.empty())
+            throw std::runtime_error("Not enough arguments");
+
+        auto& storage = *NativeState<Elements>(scope);
+        const auto it = storage.begin() + index(storage, args[0], false);
+        auto removed = std::make_shared<Value>(std::move(*it));
+
+        storage.erase(it);
+
+        return removed;
+    });
+
+    method(*array, "reserve", [](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.empty())
+            throw std::runtime_error("Not enough arguments");
+
+        NativeState<Elements>(scope)->reserve(GetCount(args[0]));
+
+        return nullptr;
+    });
+
+    method(*array, "clear", [](const auto&, const ScopePtr& scope) -> ValuePtr
+    {
+        NativeState<Elements>(scope)->clear();
+
+        return nullptr;
+    });
+
+    method(*array, "size", [](const auto&, const ScopePtr& scope) -> ValuePtr
+    {
+        return std::make_shared<Value>(static_cast<int>(NativeState<Elements>(scope)->size()));
+    });
+
+    method(*array, "capacity", [](const auto&, const ScopePtr& scope) -> ValuePtr
+    {
+        return std::make_shared<Value>(static_cast<int>(NativeState<Elements>(scope)->capacity()));
+    });
+
+    globalScope->Get("array") = std::move(array);
+
+    using Table = std::shared_ptr<HashMap>;
+
+    auto map = std::make_shared<StructDecl>("map");
+    map->nativeInit = [] { return std::any(std::make_shared<HashMap>()); };
+
+    // for-in goes over the keys, the position is one past the slot of the last one
+    map->nativeNext = [](const std::any& state, size_t& position) -> const Value*
+    {
+        const auto& table = std::any_cast<const Table&>(state);
+
+        const auto slot = table->Next(static_cast<int64_t>(position) - 1);
+        if(slot < 0)
+            return nullptr;
+
+        position = static_cast<size_t>(slot) + 1;
+        return &table->KeyAt(static_cast<size_t>(slot));
+    };
+
+    const auto slot = [](const ValuePtr& value)
+    {
+        return static_cast<size_t>(std::get<int>(*value));
+    };
+
+    // Assigning to the value stores it back under its key, like array elements
+    const auto reference = [](const Table& table, const Value& key, const Value& value)
+    {
+        return IndexExpr::Reference(value, [weak = std::weak_ptr(table), key](const Value& value)
+        {
+            const auto entries = weak.lock();
+            const auto stored = entries ? entries->Find(key) : nullptr;
+            if(!stored)
+                throw std::runtime_error("Key not found");
+
+            *stored = value;
+        });
+    };
+
+    method(*map, "get", [reference](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.empty())
+            throw std::runtime_error("Not enough arguments");
+
+        const auto& table = NativeState<Table>(scope);
+
+        if(const auto value = table->Find(*args[0]))
+            return reference(table, *args[0], *value);
+
+        if(args.size() < 2)
+            throw std::runtime_error("Key not found");
+
+        return std::make_shared<Value>(*args[1]);
+    });
+
+    method(*map, "set", [](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.size() < 2)
+            throw std::runtime_error("Not enough arguments");
+
+        NativeState<Table>(scope)->Insert(*args[0]) = *args[1];
+
+        return nullptr;
+    });
+
+    method(*map, "contains", [](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.empty())
+            throw std::runtime_error("Not enough arguments");
+
+        return std::make_shared<Value>(NativeState<Table>(scope)->Find(*args[0]) != nullptr);
+    });
+
+    method(*map, "remove", [](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.empty())
+            throw std::runtime_error("Not enough arguments");
+
+        return std::make_shared<Value>(NativeState<Table>(scope)->Erase(*args[0]));
+    });
+
+    method(*map, "reserve", [](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.empty())
+            throw std::runtime_error("Not enough arguments");
+
+        NativeState<Table>(scope)->Reserve(GetCount(args[0]));
+
+        return nullptr;
+    });
+
+    method(*map, "clear", [](const auto&, const ScopePtr& scope) -> ValuePtr
+    {
+        NativeState<Table>(scope)->Clear();
+
+        return nullptr;
+    });
+
+    method(*map, "size", [](const auto&, const ScopePtr& scope) -> ValuePtr
+    {
+        return std::make_shared<Value>(static_cast<int>(NativeState<Table>(scope)->Size()));
+    });
+
+    // Iteration goes over slots: next() gives the first one, next(slot) the one after it and -1 at the end
+    method(*map, "next", [](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        const auto from = args.empty() ? -1 : std::get<int>(*args[0]);
+
+        return std::make_shared<Value>(static_cast<int>(NativeState<Table>(scope)->Next(from)));
+    });
+
+    method(*map, "key", [slot](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.empty())
+            throw std::runtime_error("Not enough arguments");
+
+        return std::make_shared<Value>(NativeState<Table>(scope)->KeyAt(slot(args[0])));
+    });
+
+    method(*map, "value", [slot, reference](const std::vector<ValuePtr>& args, const ScopePtr& scope) -> ValuePtr
+    {
+        if(args.empty())
+            throw std::runtime_error("Not enough arguments");
+
+        const auto& table = NativeState<Table>(scope);
+        const auto at = slot(args[0]);
+
+        return reference(table, table->KeyAt(at), table->ValueAt(at));
+    });
+
+    globalScope->Get("map") = std::move(map);
 }
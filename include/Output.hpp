@@ -0,0 +1,39 @@
+#pragma once
+#include <memory>
+#include <string_view>
+
+#include "AST/Value.hpp"
+
+// Buffered stdout of the print built-ins, each thread has its own buffer
+// Flushed when full, on flush(), at exit, and after every line when stdout is a terminal
+class Output
+{
+public:
+    Output();
+    ~Output();
+
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    void Write(std::string_view text);
+    void Write(char c);
+    void WriteValue(const Value& value);
+    void EndLine();
+
+    void Flush();
+
+private:
+    template<typename T>
+    void WriteNumber(T value);
+
+    void Reserve(size_t bytes);
+
+private:
+    static constexpr size_t bufferSize = 64 * 1024;
+
+    std::unique_ptr<char[]> buffer;
+    size_t size{};
+    bool lineBuffered;
+};
+
+inline thread_local Output console;
@@ -1,5 +1,8 @@
 #pragma once
+#include <functional>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "AST/AST.hpp"
 #include "Lexer.hpp"
@@ -10,13 +13,27 @@ public:
     explicit Parser(Lexer& lexer);
     ~Parser() = default;
 
+    struct RemovedCount
+    {
+        size_t functions{}, structs{};
+    };
+
+    // Drops the functions and structures that can't be reached from main
+    RemovedCount RemoveUnused();
+
     ExprPtr GetRoot();
 
+    // Called on the thread that first calls a function, after its body was parsed
+    void OnBodyLoaded(std::function<void(StatementList&)> callback);
+
 private:
     void NextToken();
 
     ExprPtr Parse();
 
+    // Packs the largest parts of the expression that only compute values into FlatExpr nodes
+    ExprPtr Flatten(ExprPtr expr);
+
     ExprPtr ParsePrimary();
     ExprPtr ParseBinaryRight(int leftPrec, ExprPtr left);
     ExprPtr ParseUnary();
@@ -30,11 +47,16 @@ private:
     ExprPtr ParseVarOrFunc(const std::string& token);
     ExprPtr ParseIf();
     ExprPtr ParseWhile();
-    ExprPtr ParseFor();
+    ExprPtr ParseFor(bool parallel = false);
     ExprPtr ParseStruct();
 
     std::vector<ExprPtr> ParseArguments();
 
+    // Skips a function body, so it can be parsed on the first call
+    StatementList::DeferredBody SkipBody(bool& yields);
+    std::vector<ExprPtr> ParseBody(const Lexer::Location& begin, size_t end);
+    void ScanNames(const Lexer::Location& begin, size_t end, const StatementList::NameVisitor& visitor);
+
     int GetPrecedence() const;
 
     void Expect(Lexer::TokenType tokenType, bool skip = true);
@@ -71,8 +93,13 @@ private:
 private:
     Lexer& lexer;
 
-    std::vector<std::vector<Value>> dataSection;
+    std::vector<std::string> structs;
 
     Lexer::Token currentToken;
     ExprPtr root{};
+
+    // Bodies are parsed and scanned with the one lexer, so threads that call new functions take turns
+    std::mutex replayMutex;
+
+    std::function<void(StatementList&)> bodyLoaded;
 };
@@ -0,0 +1,55 @@
+#pragma once
+#include <memory>
+#include <mutex>
+
+#include "AST/Value.hpp"
+
+// Reads a file descriptor in large blocks, so scripts can stream their input without a system call per line
+// Lines and chunks are cut out of the block, short ones fit inline in the returned string
+// Calls are serialized, as spawned functions may share a reader
+class Reader
+{
+public:
+    // The descriptor stays open, it belongs to whoever opened it
+    explicit Reader(int fd);
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    // The next line without its newline, the last one may not have a newline
+    String ReadLine();
+
+    // Up to size bytes, fewer if the input has no more right now, empty at the end of the input
+    String ReadChunk(size_t size);
+
+    // Everything left until the end of the input
+    String ReadAll();
+
+    // Exactly size bytes, throws if the input ends before
+    String ReadExact(size_t size);
+
+    // True once everything was read, waits for input to know
+    bool Eof();
+
+    // Shared by input() and every reader of descriptor 0, so no buffered input is lost between them
+    static const std::shared_ptr<Reader>& Stdin();
+
+private:
+    // Reads the next block after the unread bytes, false at the end of the input
+    bool Fill();
+
+    std::string_view Take(size_t size);
+
+private:
+    static constexpr size_t blockSize = 1024 * 1024;
+
+    int fd;
+
+    std::unique_ptr<char[]> buffer;
+    size_t capacity = blockSize, begin{}, end{};
+    bool finished{};
+
+    std::mutex mutex;
+};
+
+using ReaderPtr = std::shared_ptr<Reader>;
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "AST/AST.hpp"
+
+// Writes values in a compact binary form, so pipeline stages can pass results on without printing and parsing text
+// A record is a header with the length of its body, followed by one tagged value:
+// numbers as varints or raw bytes, strings and packed arrays with their length, structures by name with
+// their fields and then their array members in declaration order, and buffers made by alloc with their element count
+// Pointers inside values aren't followed, nothing tells how many elements they point to
+class Serializer
+{
+public:
+    Serializer() = default;
+    ~Serializer() = default;
+
+    // A record of the value
+    std::string Save(const Value& value);
+
+    // A record of count elements of a buffer made by alloc
+    std::string Save(const Value* values, size_t count);
+
+    // The value of the record, structures are looked up in the scope and buffers are allocated on the heap
+    Value Load(std::string_view record, const ScopePtr& scope);
+
+    // The same for a body whose header was already read
+    Value LoadBody(std::string_view body, const ScopePtr& scope);
+
+    // The length of the body that follows the header
+    static size_t BodySize(std::string_view header);
+
+public:
+    static constexpr size_t headerSize = sizeof(uint32_t) + sizeof(uint64_t);
+
+private:
+    enum class Tag : uint8_t
+    {
+        Int, Float, Double, Bool, Char, String, Packed, Struct, Buffer
+    };
+
+    void Begin();
+    std::string Finish();
+
+    void WriteValue(const Value& value);
+    void WriteStruct(const StructInstance& instance);
+    void WriteArrays(const StructDecl& structDecl, const StructInstance& instance);
+    void WriteVarint(uint64_t value);
+    void WriteBytes(std::string_view bytes);
+
+    template<typename T>
+    void Write(const T& value)
+    {
+        output.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    Value ReadValue();
+    Value ReadStruct();
+    void ReadArrays(const StructDecl& structDecl, const StructInstance& instance);
+    Value ReadBuffer();
+    uint64_t ReadVarint();
+    std::string_view ReadBytes(size_t size);
+
+    template<typename T>
+    T Read()
+    {
+        T value;
+        std::memcpy(&value, ReadBytes(sizeof(T)).data(), sizeof(T));
+
+        return value;
+    }
+
+private:
+    static constexpr uint32_t magic = 0x32565257; // "WRV2"
+
+    // Array members are written with the size they are declared with, so it has to be a number
+    static size_t ArraySize(const StructDecl& structDecl, const std::string& name);
+
+    // Structures holding each other would recurse forever
+    static constexpr size_t maxDepth = 512;
+
+private:
+    std::string output;
+    size_t depth{};
+
+    std::string_view input;
+    ScopePtr scope;
+};
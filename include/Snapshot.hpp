@@ -0,0 +1,62 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+
+#include "AST/AST.hpp"
+
+// Saves the initialized program (structures, functions and global variables),
+// so it can be started again without loading and parsing.
+// Native state (built-ins and heap memory) can't be saved and is recreated instead
+class Snapshot
+{
+public:
+    Snapshot() = default;
+    ~Snapshot() = default;
+
+    void Save(const std::filesystem::path& path, const ScopePtr& programScope);
+    void Load(const std::filesystem::path& path, const ScopePtr& programScope);
+
+private:
+    enum class NodeType : uint8_t
+    {
+        None, Value, Variable, VariableDecl, Return, Break, Continue,
+        StatementList, FunctionDecl, StructDecl, Constructor,
+        If, While, For, FunctionCall, Index, Unary, Binary, ArrayDecl, ParallelFor, Await, ForIn, Yield, Flat
+    };
+
+    static bool IsNative(const ExprPtr& node);
+
+    void WriteNode(const ExprPtr& node);
+    void WriteNodes(const std::vector<ExprPtr>& nodes);
+    void WriteValue(const Value& value);
+    void WriteString(std::string_view string);
+
+    template<typename T>
+    void Write(const T& value)
+    {
+        output.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    ExprPtr ReadNode();
+    std::vector<ExprPtr> ReadNodes();
+    Value ReadValue();
+    std::string ReadString();
+
+    template<typename T>
+    T Read()
+    {
+        T value{};
+        if(!input.read(reinterpret_cast<char*>(&value), sizeof(T)))
+            throw std::runtime_error("Unexpected end of snapshot");
+
+        return value;
+    }
+
+private:
+    static constexpr uint32_t magic = 0x53445257; // "WRDS"
+    static constexpr uint32_t version = 8;
+
+private:
+    std::ofstream output;
+    std::ifstream input;
+};
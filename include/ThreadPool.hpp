@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the tasks spawned by scripts
+// Every worker has its own queue and takes from the others when it runs out of work
+class ThreadPool
+{
+public:
+    using Job = std::function<void()>;
+
+    // Hands out the next chunk [from, to) of a parallel loop, false when the loop is done
+    using NextChunk = std::function<bool(int64_t& from, int64_t& to)>;
+    using Participant = std::function<void(const NextChunk& next)>;
+
+    explicit ThreadPool(size_t threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Shared by all interpreters, one worker per core
+    static ThreadPool& Get();
+
+    // Jobs submitted by a worker go to its own queue, the others are spread over the queues
+    void Submit(Job job);
+
+    // Runs queued jobs on the calling thread until the flag is set, so waiting threads keep working
+    void Wait(const std::atomic<bool>& done);
+
+    // Runs queued jobs on the calling thread until the count drops to zero
+    void Wait(const std::atomic<size_t>& count);
+
+    // Splits [begin, end) between the calling thread and participants - 1 jobs
+    // Each participant takes shrinking chunks from its own part and steals half of the largest part left when it runs out
+    // The first error stops the loop and is rethrown, once every participant has returned
+    void For(int64_t begin, int64_t end, size_t participants, const Participant& participant);
+
+    size_t GetThreadCount() const;
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    struct Range
+    {
+        std::mutex mutex;
+        int64_t from{}, to{};
+    };
+
+    void Work(size_t index);
+
+    // The own queue is used from the back, the others are robbed from the front
+    bool RunOne(size_t index);
+    Job Take(size_t index);
+
+private:
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::jthread> threads;
+
+    std::atomic<size_t> pending{}, nextQueue{};
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool stopping{};
+
+    static thread_local size_t workerIndex;
+};
+
+// Most threads a parallel loop of the interpreter running on this thread may use
+// 0 means one per core, 1 runs the iterations in order on the calling thread
+inline thread_local size_t parallelism{};
+
+// Counts the unfinished tasks spawned by the interpreter running on this thread
+// Tasks share it, so the last one can still signal after the interpreter has stopped waiting
+inline thread_local std::shared_ptr<std::atomic<size_t>> spawnedTasks;
@@ -1,27 +1,201 @@
-#include "NativeFunctions.hpp"
-#include "Parser.hpp"
+#include "Interpreter.hpp"
+#include "Output.hpp"
 
-#include <fstream>
+#include <optional>
 #include <print>
+#include <thread>
+
+// Only numbers and strings mean something outside the interpreter
+static std::optional<std::string> FormatResult(const ValuePtr& result)
+{
+    if(!result)
+        return {};
+
+    return std::visit([](auto&& v) -> std::optional<std::string>
+    {
+        using Type = std::decay_t<decltype(v)>;
+
+        if constexpr (std::is_same_v<Type, String>)
+            return std::string(v.View());
+        else if constexpr (std::is_arithmetic_v<Type>)
+            return std::format("{}", v);
+        else
+            return {};
+    }, *result);
+}
+
+// Runs the program in several interpreters at once, each of them must return what a single run does
+static int RunInstances(const std::filesystem::path& filename, const size_t count)
+{
+    const auto run = [&filename]
+    {
+        Interpreter interpreter;
+        interpreter.Load(filename);
+        interpreter.AnalyzeEscapes();
+
+        auto result = FormatResult(interpreter.Run());
+        console.Flush();
+
+        return result;
+    };
+
+    const auto expected = run();
+
+    std::vector<std::optional<std::string>> results(count);
+    std::vector<std::exception_ptr> errors(count);
+    {
+        std::vector<std::jthread> threads;
+        for(size_t i = 0; i < count; i++)
+            threads.emplace_back([&, i]
+            {
+                try
+                {
+                    results[i] = run();
+                }
+                catch(...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            });
+    }
+
+    size_t failed{};
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if(errors[i])
+        {
+            try
+            {
+                std::rethrow_exception(errors[i]);
+            }
+            catch(const std::exception& e)
+            {
+                std::println(stderr, "Instance {} failed: {}", i, e.what());
+            }
+
+            failed++;
+        }
+        else if(results[i] != expected)
+        {
+            std::println(stderr, "Instance {} returned {} instead of {}", i, results[i].value_or("nothing"), expected.value_or("nothing"));
+            failed++;
+        }
+    }
+
+    std::println("{} of {} instances returned {}", count - failed, count, expected.value_or("nothing"));
+
+    return failed ? 1 : 0;
+}
 
 int main(int argc, char** argv)
 {
-    if(argc < 2)
+    std::filesystem::path filename, snapshotPath, restorePath;
+    bool verbose{}, checkMemory{};
+    size_t instances{}, threads{}, memoryQuota{};
+    int64_t fuel{}, slice{};
+
+    for(int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+
+        if(arg == "--verbose")
+            verbose = true;
+        else if(arg == "--check-memory")
+            checkMemory = true;
+        else if(arg == "--snapshot" && i + 1 < argc)
+            snapshotPath = argv[++i];
+        else if(arg == "--from-snapshot" && i + 1 < argc)
+            restorePath = argv[++i];
+        else if(arg == "--instances" && i + 1 < argc)
+            instances = std::stoul(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = std::stoul(argv[++i]);
+        else if(arg == "--deterministic")
+            threads = 1;
+        else if(arg == "--fuel" && i + 1 < argc)
+            fuel = std::stoll(argv[++i]);
+        else if(arg == "--slice" && i + 1 < argc)
+            slice = std::stoll(argv[++i]);
+        else if(arg == "--memory-quota" && i + 1 < argc)
+            memoryQuota = std::stoul(argv[++i]);
+        else
+            filename = arg;
+    }
+
+    if(filename.empty() && restorePath.empty())
         throw std::runtime_error("You should specify the filename");
 
-    Lexer lexer({ argv[1] });
-    Parser parser(lexer);
+    if(instances > 0)
+        return RunInstances(filename, instances);
+
+    Interpreter interpreter;
+    interpreter.GetHeap().SetChecked(checkMemory);
+    interpreter.GetHeap().SetQuota(memoryQuota);
+    interpreter.SetParallelism(threads);
 
-    DefineDefaultFunctions();
+    // Global variables are initialized by script code too
+    if(fuel > 0)
+        interpreter.GetBudget().SetFuel(fuel);
 
-    const auto programScope = std::make_shared<Scope>(globalScope);
+    std::optional<std::string> result;
+
+    try
+    {
+        if(restorePath.empty())
+        {
+            if(const auto [functions, structs] = interpreter.Load(filename); verbose)
+                std::println(stderr, "Removed {} unused functions and {} unused structures", functions, structs);
+        }
+        else
+            interpreter.Restore(restorePath);
+
+        if(!snapshotPath.empty())
+        {
+            interpreter.Save(snapshotPath);
+            return 0;
+        }
 
-    parser.GetRoot()->Evaluate(programScope);
+        interpreter.AnalyzeEscapes();
 
-    if(const auto result = programScope->Get("main")->Evaluate(programScope))
-        std::visit([](auto&& v)
+        if(slice > 0)
         {
-            if constexpr (!std::is_same_v<std::decay_t<decltype(v)>, std::any>)
-                std::println("Value: {}", v);
-        }, *result);
+            // Pauses after every slice like a host sharing the thread would, the fuel limits the slices
+            size_t slices = 1;
+            std::optional<ValuePtr> finished;
+
+            while(!(finished = interpreter.RunFor(slice)))
+                if(++slices; fuel > 0 && static_cast<int64_t>(slices) * slice > fuel)
+                    throw BudgetExceeded("Execution budget exhausted");
+
+            if(verbose)
+                std::println(stderr, "Ran in {} slices of {} fuel", slices, slice);
+
+            result = FormatResult(*finished);
+        }
+        else
+            result = FormatResult(interpreter.Run());
+    }
+    catch(const BudgetExceeded& e)
+    {
+        console.Flush();
+        std::println(stderr, "Stopped: {}", e.what());
+
+        return 2;
+    }
+
+    // The program output goes first
+    console.Flush();
+
+    if(result)
+        std::println("Value: {}", *result);
+
+    if(verbose)
+    {
+        std::println(stderr, "Kept {} structure instances in frames", interpreter.GetKeptInFrames());
+
+        const auto [liveBytes, peakBytes, allocations, reallocations, frees] = interpreter.GetHeap().GetStats();
+        std::println(stderr, "Heap: {} allocations, {} reallocations, {} frees, {} bytes peak, {} bytes live",
+            allocations, reallocations, frees, peakBytes, liveBytes);
+    }
 }
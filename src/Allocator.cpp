@@ -0,0 +1,284 @@
+#include "Allocator.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include "Budget.hpp"
+
+thread_local Allocator::CacheRef Allocator::lastCache{};
+
+Allocator::Allocator()
+    : id(nextId++)
+{}
+
+// Blocks still in use are released too, the values pointing to them must be gone by now
+Allocator::~Allocator()
+{
+    for(const auto header : largeBlocks)
+        std::free(header);
+}
+
+Allocator::Cache::~Cache()
+{
+    for(const auto slab : slabMemory)
+        std::free(slab);
+}
+
+void* Allocator::Allocate(const size_t size)
+{
+    CheckQuota(size);
+
+    return AllocateBlock(size);
+}
+
+void* Allocator::AllocateBlock(const size_t size)
+{
+    const auto sizeClass = GetSizeClass(size + sizeof(BlockHeader));
+
+    BlockHeader* header;
+
+    if(sizeClass == largeBlock)
+    {
+        header = static_cast<BlockHeader*>(std::malloc(size + sizeof(BlockHeader)));
+        if(header)
+            TrackLarge(header, nullptr);
+    }
+    else if(auto& cache = GetCache(); auto& list = cache.freeLists[sizeClass])
+    {
+        header = reinterpret_cast<BlockHeader*>(list);
+        list = list->next;
+    }
+    else
+        header = Carve(cache, sizeClass);
+
+    if(!header)
+        return nullptr;
+
+    header->sizeClass = sizeClass;
+    header->size = size;
+
+    Register(header + 1);
+
+    allocations++;
+    AddLiveBytes(static_cast<ptrdiff_t>(size));
+
+    return header + 1;
+}
+
+void* Allocator::Reallocate(void* ptr, const size_t size)
+{
+    if(!ptr)
+        return Allocate(size);
+
+    Validate(ptr);
+
+    auto header = static_cast<BlockHeader*>(ptr) - 1;
+    const auto oldSize = header->size;
+
+    if(size > oldSize)
+        CheckQuota(size - oldSize);
+
+    // The block is already big enough
+    if(header->sizeClass != largeBlock && size + sizeof(BlockHeader) <= classSizes[header->sizeClass])
+    {
+        header->size = size;
+
+        reallocations++;
+        AddLiveBytes(static_cast<ptrdiff_t>(size) - static_cast<ptrdiff_t>(oldSize));
+
+        return ptr;
+    }
+
+    if(header->sizeClass == largeBlock && GetSizeClass(size + sizeof(BlockHeader)) == largeBlock)
+    {
+        TrackLarge(nullptr, header);
+
+        const auto resized = static_cast<BlockHeader*>(std::realloc(header, size + sizeof(BlockHeader)));
+        if(!resized)
+        {
+            TrackLarge(header, nullptr);
+            return nullptr;
+        }
+
+        header = resized;
+        TrackLarge(header, nullptr);
+        header->size = size;
+
+        Unregister(ptr);
+        Register(header + 1);
+
+        reallocations++;
+        AddLiveBytes(static_cast<ptrdiff_t>(size) - static_cast<ptrdiff_t>(oldSize));
+
+        return header + 1;
+    }
+
+    // Only the growth counts against the quota, the old block is freed right after
+    const auto ret = AllocateBlock(size);
+    if(!ret)
+        return nullptr;
+
+    std::memcpy(ret, ptr, std::min(size, oldSize));
+    Free(ptr);
+
+    return ret;
+}
+
+void Allocator::Free(void* ptr)
+{
+    if(!ptr)
+        return;
+
+    Validate(ptr);
+    Unregister(ptr);
+
+    const auto header = static_cast<BlockHeader*>(ptr) - 1;
+
+    frees++;
+    AddLiveBytes(-static_cast<ptrdiff_t>(header->size));
+
+    if(header->sizeClass == largeBlock)
+    {
+        TrackLarge(nullptr, header);
+        std::free(header);
+        return;
+    }
+
+    auto& list = GetCache().freeLists[header->sizeClass];
+
+    const auto block = reinterpret_cast<FreeBlock*>(header);
+    block->next = list;
+    list = block;
+}
+
+void Allocator::SetChecked(const bool checked)
+{
+    this->checked = checked;
+}
+
+void Allocator::SetQuota(const size_t bytes)
+{
+    quota = bytes;
+}
+
+Allocator::Stats Allocator::GetStats() const
+{
+    return { liveBytes, peakBytes, allocations, reallocations, frees };
+}
+
+uint32_t Allocator::GetSizeClass(const size_t size)
+{
+    for(uint32_t i = 0; i < classSizes.size(); i++)
+        if(size <= classSizes[i])
+            return i;
+
+    return largeBlock;
+}
+
+Allocator::Cache& Allocator::GetCache()
+{
+    if(lastCache.owner == id)
+        return *lastCache.cache;
+
+    std::lock_guard lock(blocksMutex);
+
+    auto& cache = caches[std::this_thread::get_id()];
+    if(!cache)
+        cache = std::make_unique<Cache>();
+
+    lastCache = { id, cache.get() };
+
+    return *cache;
+}
+
+Allocator::BlockHeader* Allocator::Carve(Cache& cache, const uint32_t sizeClass)
+{
+    auto& [position, end] = cache.slabs[sizeClass];
+
+    if(position == end)
+    {
+        position = static_cast<char*>(std::malloc(slabSize));
+        if(!position)
+            return nullptr;
+
+        cache.slabMemory.push_back(position);
+        end = position + slabSize;
+    }
+
+    const auto header = reinterpret_cast<BlockHeader*>(position);
+    position += classSizes[sizeClass];
+
+    return header;
+}
+
+void Allocator::Validate(void* ptr)
+{
+    // Checked before the header is read, so foreign pointers are never dereferenced
+    if(!checked)
+        return;
+
+    std::lock_guard lock(checkedMutex);
+
+    if(liveBlocks.contains(ptr))
+        return;
+
+    if(freedBlocks.contains(ptr))
+        throw std::runtime_error("Double free");
+
+    throw std::runtime_error("Pointer wasn't allocated by alloc");
+}
+
+void Allocator::Register(void* ptr)
+{
+    if(!checked)
+        return;
+
+    std::lock_guard lock(checkedMutex);
+
+    freedBlocks.erase(ptr);
+    liveBlocks.insert(ptr);
+}
+
+void Allocator::Unregister(void* ptr)
+{
+    if(!checked)
+        return;
+
+    std::lock_guard lock(checkedMutex);
+
+    liveBlocks.erase(ptr);
+    freedBlocks.insert(ptr);
+    freedOrder.push_back(ptr);
+
+    // Older frees are forgotten, freeing those pointers again is reported as a foreign pointer
+    if(freedOrder.size() > maxFreedKept)
+    {
+        freedBlocks.erase(freedOrder.front());
+        freedOrder.pop_front();
+    }
+}
+
+void Allocator::TrackLarge(BlockHeader* header, BlockHeader* replaced)
+{
+    std::lock_guard lock(blocksMutex);
+
+    if(replaced)
+        largeBlocks.erase(replaced);
+    if(header)
+        largeBlocks.insert(header);
+}
+
+// Threads allocating at once may pass the quota by their allocations together
+void Allocator::CheckQuota(const size_t growth) const
+{
+    if(const auto limit = quota.load(); limit && liveBytes + growth > limit)
+        throw BudgetExceeded(std::format("Memory quota of {} bytes exceeded", limit));
+}
+
+void Allocator::AddLiveBytes(const ptrdiff_t size)
+{
+    const auto live = liveBytes += size;
+    for(auto peak = peakBytes.load(); live > peak && !peakBytes.compare_exchange_weak(peak, live);) {}
+}
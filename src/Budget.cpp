@@ -0,0 +1,124 @@
+#include "Budget.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+#include "Fiber.hpp"
+
+void Budget::SetFuel(const int64_t fuel)
+{
+    this->fuel = fuel;
+}
+
+void Budget::AddFuel(const int64_t fuel)
+{
+    if(fuel <= 0)
+        return;
+
+    for(auto left = this->fuel.load(); left != unlimited
+        && !this->fuel.compare_exchange_weak(left, left > unlimited - fuel ? unlimited : left + fuel);) {}
+}
+
+int64_t Budget::GetFuel() const
+{
+    return fuel;
+}
+
+void Budget::SetPausable(Fiber* fiber)
+{
+    pausable = fiber;
+}
+
+Budget* Budget::Bind(Budget* next)
+{
+    if(bound)
+        bound->AddFuel(sliceLeft);
+
+    sliceLeft = 0;
+
+    return std::exchange(bound, next);
+}
+
+Budget* Budget::Current()
+{
+    return bound;
+}
+
+void Budget::Settle()
+{
+    // The rest of the slice is borrowed as well, so it is dropped
+    if(const auto pausable = bound->pausable.load(); pausable && pausable == Fiber::Current())
+        Refill();
+}
+
+void Budget::Refill()
+{
+    // The spend that emptied the slice
+    sliceLeft = 0;
+
+    const auto budget = bound;
+    if(!budget)
+        return;
+
+    for(auto left = budget->fuel.load();;)
+    {
+        if(left == unlimited)
+        {
+            sliceLeft = sliceSize;
+            return;
+        }
+
+        if(left > 0)
+        {
+            const auto taken = std::min(left, sliceSize);
+            if(budget->fuel.compare_exchange_weak(left, left - taken))
+            {
+                sliceLeft = taken - 1;
+                return;
+            }
+
+            continue;
+        }
+
+        // Destructors of script structures still run while the error unwinds, on a few slices that the next error
+        // gives back. When those are gone the destructors stop with BudgetExceeded, which they drop
+        if(std::uncaught_exceptions() > 0)
+        {
+            if(unwindLeft > 0)
+            {
+                unwindLeft--;
+                sliceLeft = sliceSize - 1;
+                return;
+            }
+
+            throw BudgetExceeded("Execution budget exhausted");
+        }
+
+        const auto pausable = budget->pausable.load();
+
+        // The host resumes the fiber once it added fuel
+        if(pausable && Fiber::Current() == pausable && destructorDepth == 0)
+        {
+            pausable->Suspend();
+            left = budget->fuel.load();
+
+            continue;
+        }
+
+        if(pausable && left > -maxBorrowed)
+        {
+            if(budget->fuel.compare_exchange_weak(left, left - sliceSize))
+            {
+                sliceLeft = sliceSize - 1;
+                return;
+            }
+
+            continue;
+        }
+
+        unwindLeft = unwindSlices;
+
+        throw BudgetExceeded("Execution budget exhausted");
+    }
+}
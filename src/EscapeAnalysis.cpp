@@ -0,0 +1,234 @@
+#include "EscapeAnalysis.hpp"
+
+#include <algorithm>
+
+void EscapeAnalysis::Run(const ScopePtr& programScope)
+{
+    const std::lock_guard lock(mutex);
+
+    for(const auto& [name, node] : globalScope->symbols)
+        if(const auto structDecl = dynamic_cast<StructDecl*>(node.get()))
+            structs[name] = structDecl;
+
+    for(const auto& [name, node] : programScope->symbols)
+    {
+        const auto body = dynamic_cast<StatementList*>(node.get());
+        if(!body || body->nativeFunc)
+            continue;
+
+        Function function{ node };
+        for(const auto& i : body->args)
+            function.params.push_back(dynamic_cast<VariableDecl*>(i.get())->name);
+        // Coroutines and generators outlive the frame of their caller, so everything passed to them escapes
+        function.outlivesCaller = body->isAsync || body->isGenerator;
+
+        if(!body->IsLoaded())
+            pending.insert(body);
+
+        functions.emplace(name, std::move(function));
+    }
+
+    Update();
+}
+
+void EscapeAnalysis::BodyLoaded(StatementList& body)
+{
+    const std::lock_guard lock(mutex);
+
+    // Methods and bodies of functions that were never seen don't change anything
+    if(pending.erase(&body))
+        Update();
+}
+
+size_t EscapeAnalysis::GetKept() const
+{
+    const std::lock_guard lock(mutex);
+
+    return kept;
+}
+
+void EscapeAnalysis::Update()
+{
+    // Bodies parsed by other threads meanwhile are analyzed again, when their call gets the lock
+    for(auto& function : functions | std::views::values)
+        function.analyzed = static_cast<StatementList*>(function.body.get())->IsLoaded();
+
+    // Methods that pass 'this' on are judged by the parameters they pass it to, so those go first
+    AnalyzeParams();
+    AnalyzeStructs();
+
+    // Methods are left alone, as they may run in the scope of their instance
+    for(const auto& function : functions | std::views::values)
+        if(function.analyzed)
+            kept += MarkConstructors(function.body, function.body);
+}
+
+void EscapeAnalysis::AnalyzeParams()
+{
+    // Every parameter of a parsed body starts as not escaping, until a use says otherwise
+    for(auto& function : functions | std::views::values)
+        function.escapes.assign(function.params.size(), function.outlivesCaller || !function.analyzed);
+
+    for(bool changed = true; changed;)
+    {
+        changed = false;
+
+        for(auto& [body, params, escapes, outlivesCaller, analyzed] : functions | std::views::values)
+            for(size_t i = 0; analyzed && i < params.size(); i++)
+                if(!escapes[i] && Escapes(body, params[i]))
+                    escapes[i] = changed = true;
+    }
+}
+
+void EscapeAnalysis::AnalyzeStructs()
+{
+    leakingStructs.clear();
+
+    for(const auto& [name, structDecl] : structs)
+    {
+        // Native methods can do anything with the instance
+        if(structDecl->nativeInit)
+            leakingStructs.insert(name);
+
+        for(const auto& [member, value] : structDecl->content)
+        {
+            memberNames.insert(member);
+
+            const auto method = dynamic_cast<FunctionDecl*>(value.get());
+            if(!method)
+                continue;
+
+            if(const auto body = dynamic_cast<StatementList*>(method->body.get()); body->nativeFunc)
+                leakingStructs.insert(name);
+            // Generators and coroutines of methods run in their instance after the call returns
+            else if(body->isGenerator || body->isAsync)
+                leakingStructs.insert(name);
+            else if(Escapes(method->body, "this"))
+                leakingStructs.insert(name);
+        }
+    }
+}
+
+size_t EscapeAnalysis::MarkConstructors(const ExprPtr& node, const ExprPtr& function)
+{
+    if(!node)
+        return 0;
+
+    size_t marked{};
+
+    const auto list = dynamic_cast<StatementList*>(node.get());
+
+    // Nested functions are marked once they are called
+    if(list && !list->IsLoaded())
+    {
+        pending.insert(list);
+        return 0;
+    }
+
+    if(list && !list->statements.empty())
+    {
+        // The last statement is the result of the list, so its value leaves the frame
+        for(const auto& statement : list->statements | std::views::take(list->statements.size() - 1))
+        {
+            const auto assignment = dynamic_cast<BinaryExpr*>(statement.get());
+            if(!assignment || assignment->operation != Lexer::TokenType::Equal)
+                continue;
+
+            const auto variable = dynamic_cast<VariableDecl*>(assignment->left.get());
+            const auto constructor = dynamic_cast<ConstructorExpr*>(assignment->right.get());
+
+            if(variable && constructor && !std::atomic_ref(constructor->inFrame).load(std::memory_order_relaxed)
+                && structs.contains(constructor->name) && !leakingStructs.contains(constructor->name)
+                && !Escapes(function, variable->name))
+            {
+                std::atomic_ref(constructor->inFrame).store(true, std::memory_order_relaxed);
+                marked++;
+            }
+        }
+    }
+
+    node->ForEachChild([&](const ExprPtr& child)
+    {
+        marked += MarkConstructors(child, function);
+    });
+
+    return marked;
+}
+
+bool EscapeAnalysis::Escapes(const ExprPtr& node, const std::string& name) const
+{
+    if(!node)
+        return false;
+
+    // Bodies that weren't parsed yet aren't parsed for the walk, any mention of the variable counts
+    if(const auto list = dynamic_cast<StatementList*>(node.get()))
+    {
+        bool mentioned{};
+
+        if(list->ForEachName([&](const std::string& i) { mentioned = mentioned || i == name; }))
+            return mentioned;
+    }
+
+    // Any use of the variable that isn't allowed below hands the instance over
+    if(const auto variable = dynamic_cast<VariableExpr*>(node.get()))
+        return variable->name == name;
+
+    if(const auto flat = dynamic_cast<FlatExpr*>(node.get()))
+        return std::ranges::find(flat->names, name) != flat->names.end();
+
+    if(const auto binary = dynamic_cast<BinaryExpr*>(node.get()))
+    {
+        if(binary->operation == Lexer::TokenType::Dot)
+        {
+            if(!IsVariable(binary->left, name) && Escapes(binary->left, name))
+                return true;
+
+            // Members are looked up in the instance
+            if(dynamic_cast<VariableExpr*>(binary->right.get()))
+                return false;
+
+            return Escapes(binary->right, name);
+        }
+
+        // Overwriting the variable only drops the old instance
+        if(binary->operation == Lexer::TokenType::Equal && IsVariable(binary->left, name))
+            return Escapes(binary->right, name);
+    }
+
+    if(const auto call = dynamic_cast<FunctionCall*>(node.get()))
+    {
+        for(size_t i = 0; i < call->args.size(); i++)
+            if(IsVariable(call->args[i], name) ? ArgumentEscapes(*call, i) : Escapes(call->args[i], name))
+                return true;
+
+        return false;
+    }
+
+    bool escapes{};
+
+    node->ForEachChild([&](const ExprPtr& child)
+    {
+        escapes = escapes || Escapes(child, name);
+    });
+
+    return escapes;
+}
+
+bool EscapeAnalysis::ArgumentEscapes(const FunctionCall& call, const size_t index) const
+{
+    // Inside a struct the call may go to a method with the same name
+    if(memberNames.contains(call.name))
+        return true;
+
+    const auto function = functions.find(call.name);
+
+    return function == functions.end()
+        || index >= function->second.escapes.size()
+        || function->second.escapes[index];
+}
+
+bool EscapeAnalysis::IsVariable(const ExprPtr& node, const std::string& name)
+{
+    const auto variable = dynamic_cast<VariableExpr*>(node.get());
+    return variable && variable->name == name;
+}
@@ -0,0 +1,434 @@
+#include "EventLoop.hpp"
+
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <format>
+#include <ranges>
+#include <stdexcept>
+
+#include <csignal>
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Budget.hpp"
+#include "AST/String.hpp"
+
+namespace
+{
+
+std::runtime_error SystemError(const std::string_view what)
+{
+    return std::runtime_error(std::format("{}: {}", what, std::strerror(errno)));
+}
+
+// Pipes have no flag like MSG_NOSIGNAL, so SIGPIPE is blocked on this thread for the write
+// and taken back when the write raised it, a closed reader fails the write with EPIPE instead of ending the process
+ssize_t WriteToPipe(const int fd, const char* data, const size_t size)
+{
+    sigset_t brokenPipe, previous, pending;
+    sigemptyset(&brokenPipe);
+    sigaddset(&brokenPipe, SIGPIPE);
+
+    pthread_sigmask(SIG_BLOCK, &brokenPipe, &previous);
+    sigpending(&pending);
+
+    const auto count = ::write(fd, data, size);
+    const auto error = errno;
+
+    // One that was pending before isn't ours to take
+    if(count < 0 && error == EPIPE && !sigismember(&pending, SIGPIPE))
+    {
+        constexpr timespec poll{};
+        while(sigtimedwait(&brokenPipe, nullptr, &poll) < 0 && errno == EINTR) {}
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    errno = error;
+
+    return count;
+}
+
+}
+
+struct EventLoop::Coroutine
+{
+    explicit Coroutine(std::function<void()> function)
+        : fiber(std::move(function))
+    {}
+
+    Fiber fiber;
+    TaskPtr task;
+    std::list<std::unique_ptr<Coroutine>>::iterator position;
+};
+
+EventLoop::EventLoop()
+    : epoll(epoll_create1(EPOLL_CLOEXEC))
+{
+    if(epoll < 0)
+        throw SystemError("Event loop creation failed");
+}
+
+EventLoop::~EventLoop()
+{
+    close(epoll);
+}
+
+EventLoop& EventLoop::Get()
+{
+    if(bound)
+        return *bound;
+
+    thread_local EventLoop loop;
+    return loop;
+}
+
+EventLoop::TaskPtr EventLoop::Start(Body body)
+{
+    auto task = std::make_shared<Task>();
+    task->loop = this;
+
+    // The coroutine holds the task, so it outlives the fiber
+    auto coroutine = std::make_unique<Coroutine>([body = std::move(body), result = &task->result]
+    {
+        *result = body();
+    });
+
+    coroutine->task = task;
+
+    coroutines.push_back(std::move(coroutine));
+    coroutines.back()->position = std::prev(coroutines.end());
+
+    ready.push_back(coroutines.back().get());
+
+    return task;
+}
+
+EventLoop::TaskPtr EventLoop::Read(const int fd, const size_t size)
+{
+    Operation operation{ std::make_shared<Task>(), {}, size };
+    operation.task->loop = this;
+
+    auto task = operation.task;
+
+    if(Watching(fd, EPOLLIN))
+        watches[fd].reads.push_back(std::move(operation));
+    else
+    {
+        while(!Perform(operation, fd, Descriptor::File, true, size));
+        Complete(*task);
+    }
+
+    return task;
+}
+
+EventLoop::TaskPtr EventLoop::Write(const int fd, std::string data)
+{
+    Operation operation{ std::make_shared<Task>(), std::move(data) };
+    operation.task->loop = this;
+
+    auto task = operation.task;
+
+    if(Watching(fd, EPOLLOUT))
+        watches[fd].writes.push_back(std::move(operation));
+    else
+    {
+        while(!Perform(operation, fd, Descriptor::File, false, operation.data.size()));
+        Complete(*task);
+    }
+
+    return task;
+}
+
+EventLoop::TaskPtr EventLoop::Sleep(const std::chrono::milliseconds duration)
+{
+    auto task = std::make_shared<Task>();
+    task->loop = this;
+
+    timers.push({ std::chrono::steady_clock::now() + duration, task });
+
+    return task;
+}
+
+ValuePtr EventLoop::Await(const TaskPtr& task)
+{
+    if(task->loop != this)
+        throw std::runtime_error("Tasks can only be awaited on the thread that started them");
+
+    if(!task->done)
+    {
+        if(current)
+        {
+            // Generators running inside a coroutine have their own stack, which the loop can't switch to
+            if(Fiber::Current() != &current->fiber)
+                throw std::runtime_error("Generators can't await inside async functions");
+
+            task->waiting.push_back(current);
+            Suspend();
+        }
+        else
+            RunUntil(task.get());
+    }
+
+    if(task->error)
+        std::rethrow_exception(task->error);
+
+    return task->result;
+}
+
+void EventLoop::Run()
+{
+    RunUntil(nullptr);
+}
+
+void EventLoop::Cancel()
+{
+    for(const auto fd : watches | std::views::keys)
+        epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+
+    watches.clear();
+    timers = {};
+    ready.clear();
+
+    // Coroutines that didn't start are just dropped, the others unwind
+    while(!coroutines.empty())
+    {
+        const auto coroutine = std::move(coroutines.front());
+        coroutines.pop_front();
+
+        current = coroutine.get();
+        coroutine->fiber.Cancel();
+        current = nullptr;
+    }
+}
+
+void EventLoop::RunUntil(const Task* task)
+{
+    while(!task || !task->done)
+    {
+        if(!ready.empty())
+        {
+            const auto coroutine = ready.front();
+            ready.pop_front();
+
+            Resume(*coroutine);
+            Budget::Checkpoint();
+
+            continue;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+
+        if(!timers.empty() && timers.top().deadline <= now)
+        {
+            const auto timer = timers.top();
+            timers.pop();
+
+            Complete(*timer.task);
+
+            continue;
+        }
+
+        if(watches.empty() && timers.empty())
+        {
+            if(task)
+                throw std::runtime_error("The awaited task can never finish");
+
+            return;
+        }
+
+        auto timeout = -1;
+        if(!timers.empty())
+            timeout = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(timers.top().deadline - now).count());
+
+        Poll(timeout);
+    }
+}
+
+void EventLoop::Resume(Coroutine& coroutine)
+{
+    current = &coroutine;
+
+    try
+    {
+        coroutine.fiber.Resume();
+    }
+    catch(...)
+    {
+        coroutine.task->error = std::current_exception();
+    }
+
+    current = nullptr;
+
+    if(coroutine.fiber.IsFinished())
+    {
+        Complete(*coroutine.task);
+        coroutines.erase(coroutine.position);
+    }
+}
+
+void EventLoop::Suspend()
+{
+    current->fiber.Suspend();
+}
+
+void EventLoop::Complete(Task& task)
+{
+    task.done = true;
+
+    for(const auto coroutine : task.waiting)
+        ready.push_back(coroutine);
+
+    task.waiting.clear();
+}
+
+bool EventLoop::Watching(const int fd, const uint32_t events)
+{
+    const auto it = watches.find(fd);
+
+    epoll_event event{};
+    event.events = events | (it != watches.end() ? it->second.events : 0);
+    event.data.fd = fd;
+
+    if(it == watches.end())
+    {
+        if(epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            if(errno == EPERM)
+                return false;
+
+            throw SystemError(std::format("Descriptor {} can't be watched", fd));
+        }
+
+        struct stat info{};
+        const auto socket = fstat(fd, &info) == 0 && S_ISSOCK(info.st_mode);
+
+        watches[fd].events = event.events;
+        watches[fd].descriptor = socket ? Descriptor::Socket : Descriptor::Pipe;
+    }
+    else if(event.events != it->second.events)
+    {
+        if(epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event) < 0)
+            throw SystemError(std::format("Descriptor {} can't be watched", fd));
+
+        it->second.events = event.events;
+    }
+
+    return true;
+}
+
+void EventLoop::Unwatch(const int fd)
+{
+    epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    watches.erase(fd);
+}
+
+void EventLoop::Poll(const int timeout)
+{
+    std::array<epoll_event, 64> events{};
+
+    const auto count = epoll_wait(epoll, events.data(), static_cast<int>(events.size()), timeout);
+    if(count < 0)
+    {
+        if(errno == EINTR)
+            return;
+
+        throw SystemError("Waiting for events failed");
+    }
+
+    for(int i = 0; i < count; i++)
+    {
+        const auto fd = events[i].data.fd;
+        const auto happened = events[i].events;
+
+        auto& watch = watches.at(fd);
+
+        // Hang ups and errors finish the operations as well, reads see the end of the file
+        constexpr auto finished = EPOLLHUP | EPOLLERR;
+
+        if(happened & (EPOLLIN | finished) && !watch.reads.empty()
+            && Perform(watch.reads.front(), fd, watch.descriptor, true, watch.reads.front().size))
+        {
+            Complete(*watch.reads.front().task);
+            watch.reads.pop_front();
+        }
+
+        // Writes of at most PIPE_BUF bytes don't block once the descriptor is writable
+        if(happened & (EPOLLOUT | finished) && !watch.writes.empty()
+            && Perform(watch.writes.front(), fd, watch.descriptor, false, PIPE_BUF))
+        {
+            Complete(*watch.writes.front().task);
+            watch.writes.pop_front();
+        }
+
+        // Level triggered events would keep waking the loop for nothing
+        const uint32_t wanted = (watch.reads.empty() ? 0 : EPOLLIN) | (watch.writes.empty() ? 0 : EPOLLOUT);
+
+        if(!wanted)
+            Unwatch(fd);
+        else if(wanted != watch.events)
+        {
+            epoll_event event{};
+            event.events = wanted;
+            event.data.fd = fd;
+
+            epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event);
+            watch.events = wanted;
+        }
+    }
+}
+
+bool EventLoop::Perform(Operation& operation, const int fd, const Descriptor descriptor, const bool read, const size_t limit)
+{
+    // Every readiness gets one system call, so blocking descriptors don't block the loop
+    if(read)
+    {
+        std::string buffer(operation.size, '\0');
+
+        const auto count = ::read(fd, buffer.data(), buffer.size());
+        if(count < 0)
+        {
+            if(errno == EINTR || errno == EAGAIN)
+                return false;
+
+            operation.task->error = std::make_exception_ptr(SystemError("Reading failed"));
+            return true;
+        }
+
+        buffer.resize(count);
+        operation.task->result = std::make_shared<Value>(String(buffer));
+
+        return true;
+    }
+
+    const auto left = operation.data.size() - operation.size;
+
+    const auto data = operation.data.data() + operation.size;
+    const auto size = std::min(left, limit);
+
+    // Only pipes and sockets raise SIGPIPE, they are the ones that can be watched
+    const auto count = descriptor == Descriptor::Socket ? send(fd, data, size, MSG_NOSIGNAL)
+        : descriptor == Descriptor::Pipe ? WriteToPipe(fd, data, size)
+        : ::write(fd, data, size);
+    if(count < 0)
+    {
+        if(errno == EINTR || errno == EAGAIN)
+            return false;
+
+        operation.task->error = std::make_exception_ptr(SystemError("Writing failed"));
+        return true;
+    }
+
+    operation.size += count;
+    if(operation.size < operation.data.size())
+        return false;
+
+    operation.task->result = std::make_shared<Value>(static_cast<int>(operation.size));
+
+    return true;
+}
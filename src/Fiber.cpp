@@ -0,0 +1,208 @@
+#include "Fiber.hpp"
+
+#include <array>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include <sys/mman.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+namespace
+{
+
+constexpr size_t guardSize = 4096;
+
+// Stacks of finished fibers are kept for the next ones, as mapping them costs system calls
+// The pool is trivially destructible, so fibers destroyed late in the thread's exit can still use it
+namespace StackPool
+{
+
+constexpr size_t maxKept = 64;
+
+thread_local std::array<void*, maxKept> kept;
+thread_local size_t keptCount;
+thread_local bool closed;
+
+// Unmaps the kept stacks when the thread exits
+struct Closer
+{
+    ~Closer()
+    {
+        for(size_t i = 0; i < keptCount; i++)
+            munmap(kept[i], Fiber::defaultStackSize);
+
+        keptCount = 0;
+        closed = true;
+    }
+};
+
+thread_local Closer closer;
+
+// Only stacks of the default size are kept
+void* Take(const size_t stackSize)
+{
+    if(stackSize == Fiber::defaultStackSize && keptCount > 0)
+        return kept[--keptCount];
+
+    const auto stack = mmap(nullptr, stackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(stack == MAP_FAILED)
+        throw std::runtime_error(std::format("Fiber stack allocation failed: {}", std::strerror(errno)));
+
+    // Overflows hit the lowest page instead of other memory
+    mprotect(stack, guardSize, PROT_NONE);
+
+    // Makes sure the closer is constructed on this thread
+    static_cast<void>(&closer);
+
+    return stack;
+}
+
+void Give(void* stack, const size_t stackSize)
+{
+    if(stackSize == Fiber::defaultStackSize && !closed && keptCount < maxKept)
+        kept[keptCount++] = stack;
+    else
+        munmap(stack, stackSize);
+}
+
+}
+
+// The address sanitizer has to know about stack switches, or it reports errors on the fiber stacks
+#if defined(__SANITIZE_ADDRESS__)
+void StartSwitch(void** fakeStack, const void* bottom, const size_t size)
+{
+    __sanitizer_start_switch_fiber(fakeStack, bottom, size);
+}
+
+void FinishSwitch(void* fakeStack, const void** bottom = nullptr, size_t* size = nullptr)
+{
+    __sanitizer_finish_switch_fiber(fakeStack, bottom, size);
+}
+#else
+void StartSwitch(void**, const void*, size_t) {}
+void FinishSwitch(void*, const void** = nullptr, size_t* = nullptr) {}
+#endif
+
+}
+
+thread_local Fiber* Fiber::current{};
+
+Fiber::Fiber(std::function<void()> function, const size_t stackSize)
+    : stack(StackPool::Take(stackSize)), stackSize(stackSize), function(std::move(function))
+{}
+
+Fiber::~Fiber()
+{
+    Cancel();
+
+    StackPool::Give(stack, stackSize);
+}
+
+void Fiber::Resume()
+{
+    if(finished)
+        return;
+
+    if(!started)
+    {
+        started = true;
+
+        getcontext(&context);
+        context.uc_stack.ss_sp = stack;
+        context.uc_stack.ss_size = stackSize;
+        context.uc_link = nullptr;
+
+        makecontext(&context, Entry, 0);
+    }
+
+    previous = std::exchange(current, this);
+    const auto callerRegion = std::exchange(FrameRegion::active, &region);
+
+    void* callerFakeStack{};
+    StartSwitch(&callerFakeStack, stack, stackSize);
+
+    swapcontext(&caller, &context);
+
+    FinishSwitch(callerFakeStack);
+
+    FrameRegion::active = callerRegion;
+    current = previous;
+
+    if(error)
+        std::rethrow_exception(std::exchange(error, {}));
+}
+
+void Fiber::Suspend()
+{
+    StartSwitch(&fakeStack, callerStack, callerStackSize);
+
+    swapcontext(&context, &caller);
+
+    FinishSwitch(fakeStack, &callerStack, &callerStackSize);
+
+    if(cancelled)
+        throw Cancelled{};
+}
+
+void Fiber::Cancel()
+{
+    if(!started || finished)
+    {
+        function = {};
+        finished = true;
+
+        return;
+    }
+
+    cancelled = true;
+
+    try
+    {
+        Resume();
+    }
+    catch(...) {}
+}
+
+bool Fiber::IsStarted() const
+{
+    return started;
+}
+
+bool Fiber::IsFinished() const
+{
+    return finished;
+}
+
+Fiber* Fiber::Current()
+{
+    return current;
+}
+
+void Fiber::Entry()
+{
+    auto& fiber = *current;
+
+    FinishSwitch(nullptr, &fiber.callerStack, &fiber.callerStackSize);
+
+    // Exceptions can't leave the first function on the stack, they are rethrown by Resume
+    try
+    {
+        fiber.function();
+    }
+    catch(const Cancelled&) {}
+    catch(...)
+    {
+        fiber.error = std::current_exception();
+    }
+
+    fiber.function = {};
+    fiber.finished = true;
+
+    // The stack is reused, so nothing on it may be destroyed later
+    StartSwitch(nullptr, fiber.callerStack, fiber.callerStackSize);
+    setcontext(&fiber.caller);
+}
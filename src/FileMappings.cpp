@@ -0,0 +1,28 @@
+#include "FileMappings.hpp"
+
+#include <sys/mman.h>
+
+FileMappings::~FileMappings()
+{
+    for(auto& mapping : mappings)
+        if(mapping.bytes)
+            munmap(mapping.address, mapping.length);
+}
+
+PackedArray::Mapping* FileMappings::Add(void* address, const size_t length, const size_t skipped)
+{
+    const std::lock_guard lock(mutex);
+
+    return &mappings.emplace_back(static_cast<char*>(address) + skipped, address, length);
+}
+
+void FileMappings::Release(PackedArray::Mapping& mapping)
+{
+    const std::lock_guard lock(mutex);
+
+    if(!mapping.bytes)
+        return;
+
+    mapping.bytes = nullptr;
+    munmap(mapping.address, mapping.length);
+}
@@ -0,0 +1,49 @@
+#include "Generator.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+thread_local Generator* Generator::running{};
+
+Generator::Generator(std::function<void()> body)
+    : fiber(std::move(body))
+{}
+
+const Value* Generator::Next()
+{
+    if(fiber.IsFinished())
+        return nullptr;
+
+    if(std::this_thread::get_id() != thread)
+        throw std::runtime_error("Generators can only be resumed on the thread that created them");
+
+    yielded = nullptr;
+
+    const auto previous = std::exchange(running, this);
+
+    try
+    {
+        fiber.Resume();
+    }
+    catch(...)
+    {
+        running = previous;
+        throw;
+    }
+
+    running = previous;
+
+    return yielded;
+}
+
+void Generator::Yield(const Value& value)
+{
+    const auto generator = running;
+
+    // A fiber started by the generator, like a coroutine, can't suspend the generator's stack
+    if(!generator || Fiber::Current() != &generator->fiber)
+        throw std::runtime_error("yield outside of a generator");
+
+    generator->yielded = &value;
+    generator->fiber.Suspend();
+}
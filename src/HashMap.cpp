@@ -0,0 +1,232 @@
+#include "HashMap.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+template<typename T>
+constexpr bool isKey = std::is_same_v<T, int> || std::is_same_v<T, char>
+    || std::is_same_v<T, size_t> || std::is_same_v<T, String>;
+
+// Spreads the bits, so keys that only differ in the high bits land in different groups
+size_t Mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+
+    return value;
+}
+
+}
+
+Value* HashMap::Find(const Value& key)
+{
+    const auto slot = FindSlot(key, Hash(key));
+
+    return slot < 0 ? nullptr : &slots[slot].value;
+}
+
+Value& HashMap::Insert(const Value& key)
+{
+    const auto hash = Hash(key);
+
+    if(const auto slot = FindSlot(key, hash); slot >= 0)
+        return slots[slot].value;
+
+    // Tables full of tombstones are cleaned up without growing
+    if((size + tombstones + 1) * 8 > capacity * 7)
+        Rehash((size + 1) * 16 > capacity * 7 ? std::max(capacity * 2, groupSize) : capacity);
+
+    const auto slot = FindInsertSlot(hash);
+
+    if(control[slot] == deleted)
+        tombstones--;
+
+    control[slot] = static_cast<int8_t>(hash & 0x7F);
+    slots[slot] = { key, Value{} };
+    size++;
+
+    return slots[slot].value;
+}
+
+bool HashMap::Erase(const Value& key)
+{
+    const auto slot = FindSlot(key, Hash(key));
+    if(slot < 0)
+        return false;
+
+    // A probe always stops at a group with an empty slot, so the slot can become empty again
+    if(Match(&control[slot & ~(groupSize - 1)], empty))
+        control[slot] = empty;
+    else
+    {
+        control[slot] = deleted;
+        tombstones++;
+    }
+
+    slots[slot] = {};
+    size--;
+
+    return true;
+}
+
+void HashMap::Clear()
+{
+    std::fill_n(control.get(), capacity, empty);
+    std::fill_n(slots.get(), capacity, Slot{});
+
+    size = tombstones = 0;
+}
+
+void HashMap::Reserve(const size_t size)
+{
+    size_t newCapacity = groupSize;
+    while(size * 8 > newCapacity * 7)
+        newCapacity *= 2;
+
+    if(newCapacity > capacity)
+        Rehash(newCapacity);
+}
+
+int64_t HashMap::Next(const int64_t slot) const
+{
+    for(auto i = static_cast<size_t>(std::max<int64_t>(slot + 1, 0)); i < capacity; i++)
+        if(control[i] >= 0)
+            return static_cast<int64_t>(i);
+
+    return -1;
+}
+
+const Value& HashMap::KeyAt(const size_t slot) const
+{
+    CheckSlot(slot);
+    return slots[slot].key;
+}
+
+Value& HashMap::ValueAt(const size_t slot)
+{
+    CheckSlot(slot);
+    return slots[slot].value;
+}
+
+size_t HashMap::Hash(const Value& key)
+{
+    return std::visit([&](const auto& value) -> size_t
+    {
+        using Type = std::decay_t<decltype(value)>;
+
+        // The type is part of the hash, as 1 and '\1' are different keys
+        if constexpr (std::is_same_v<Type, String>)
+            return Mix(std::hash<std::string_view>()(value.View()) + key.index());
+        else if constexpr (isKey<Type>)
+            return Mix((static_cast<uint64_t>(value) << 3) + key.index());
+        else
+            throw std::runtime_error("Invalid map key");
+    }, key);
+}
+
+bool HashMap::Equal(const Value& left, const Value& right)
+{
+    if(left.index() != right.index())
+        return false;
+
+    return std::visit([&](const auto& value) -> bool
+    {
+        using Type = std::decay_t<decltype(value)>;
+
+        if constexpr (isKey<Type>)
+            return value == std::get<Type>(right);
+        else
+            return false;
+    }, left);
+}
+
+uint32_t HashMap::Match(const int8_t* group, const int8_t byte)
+{
+#ifdef __SSE2__
+    const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(byte)));
+#else
+    uint32_t mask{};
+    for(size_t i = 0; i < groupSize; i++)
+        mask |= static_cast<uint32_t>(group[i] == byte) << i;
+
+    return mask;
+#endif
+}
+
+int64_t HashMap::FindSlot(const Value& key, const size_t hash) const
+{
+    if(!capacity)
+        return -1;
+
+    const auto groupMask = capacity / groupSize - 1;
+    const auto tag = static_cast<int8_t>(hash & 0x7F);
+
+    // Triangular steps visit every group once, as the group count is a power of two
+    for(size_t group = (hash >> 7) & groupMask, step = 1; step <= groupMask + 1; group = (group + step++) & groupMask)
+    {
+        const auto first = group * groupSize;
+
+        for(auto mask = Match(&control[first], tag); mask; mask &= mask - 1)
+            if(const auto slot = first + std::countr_zero(mask); Equal(slots[slot].key, key))
+                return static_cast<int64_t>(slot);
+
+        if(Match(&control[first], empty))
+            return -1;
+    }
+
+    return -1;
+}
+
+size_t HashMap::FindInsertSlot(const size_t hash) const
+{
+    const auto groupMask = capacity / groupSize - 1;
+
+    for(size_t group = (hash >> 7) & groupMask, step = 1;; group = (group + step++) & groupMask)
+    {
+        const auto first = group * groupSize;
+
+        // Empty and deleted slots are the only negative control bytes
+        if(const auto mask = Match(&control[first], empty) | Match(&control[first], deleted))
+            return first + std::countr_zero(mask);
+    }
+}
+
+void HashMap::Rehash(const size_t newCapacity)
+{
+    auto oldControl = std::exchange(control, std::make_unique<int8_t[]>(newCapacity));
+    auto oldSlots = std::exchange(slots, std::make_unique<Slot[]>(newCapacity));
+    const auto oldCapacity = std::exchange(capacity, newCapacity);
+
+    std::fill_n(control.get(), capacity, empty);
+    tombstones = 0;
+
+    for(size_t i = 0; i < oldCapacity; i++)
+    {
+        if(oldControl[i] < 0)
+            continue;
+
+        const auto hash = Hash(oldSlots[i].key);
+        const auto slot = FindInsertSlot(hash);
+
+        control[slot] = static_cast<int8_t>(hash & 0x7F);
+        slots[slot] = std::move(oldSlots[i]);
+    }
+}
+
+void HashMap::CheckSlot(const size_t slot) const
+{
+    if(slot >= capacity || control[slot] < 0)
+        throw std::runtime_error("Invalid map slot");
+}
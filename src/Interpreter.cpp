@@ -0,0 +1,157 @@
+#include "Interpreter.hpp"
+
+#include <algorithm>
+
+#include "EventLoop.hpp"
+#include "NativeFunctions.hpp"
+#include "Snapshot.hpp"
+
+Interpreter::Interpreter()
+    : globals(std::make_shared<Scope>()), programScope(std::make_shared<Scope>(globals))
+{}
+
+Interpreter::~Interpreter()
+{
+    // Destructors of the remaining instances are still script code
+    const auto binding = Bind();
+
+    // Spawned tasks still use the scopes and the heap, even when the program failed or was never finished
+    ThreadPool::Get().Wait(*tasks);
+
+    // A paused program unwinds without pausing again, destructors get what is left and a small allowance
+    budget.SetPausable(nullptr);
+    budget.SetFuel(std::max<int64_t>(budget.GetFuel(), 0));
+    budget.AddFuel(Budget::destructorFuel);
+    program.reset();
+
+    // Coroutines that never finished still point into the scopes
+    events.Cancel();
+
+    programScope->Reset();
+    globals->Reset();
+}
+
+Parser::RemovedCount Interpreter::Load(const std::filesystem::path& path)
+{
+    const auto binding = Bind();
+
+    lexer.emplace(path);
+    parser.emplace(*lexer);
+
+    const auto removed = parser->RemoveUnused();
+
+    DefineDefaultFunctions();
+
+    parser->GetRoot()->Evaluate(programScope);
+
+    return removed;
+}
+
+void Interpreter::Restore(const std::filesystem::path& snapshotPath)
+{
+    const auto binding = Bind();
+
+    DeclareDefaultFunctions();
+    DefineDefaultFunctions();
+
+    Snapshot().Load(snapshotPath, programScope);
+}
+
+void Interpreter::Save(const std::filesystem::path& snapshotPath)
+{
+    const auto binding = Bind();
+
+    Snapshot().Save(snapshotPath, programScope);
+}
+
+void Interpreter::AnalyzeEscapes()
+{
+    const auto binding = Bind();
+
+    escapeAnalysis.emplace();
+    escapeAnalysis->Run(programScope);
+
+    // Restored programs are parsed already
+    if(parser)
+        parser->OnBodyLoaded([analysis = &*escapeAnalysis](StatementList& body) { analysis->BodyLoaded(body); });
+}
+
+size_t Interpreter::GetKeptInFrames() const
+{
+    return escapeAnalysis ? escapeAnalysis->GetKept() : 0;
+}
+
+ValuePtr Interpreter::Run()
+{
+    const auto binding = Bind();
+
+    return RunMain();
+}
+
+std::optional<ValuePtr> Interpreter::RunFor(const int64_t fuel)
+{
+    const auto binding = Bind();
+
+    if(!program)
+    {
+        program = std::make_unique<Fiber>([this] { programResult = RunMain(); }, programStackSize);
+        budget.SetPausable(program.get());
+    }
+
+    // What was left of the previous slice is dropped, what was borrowed is paid back
+    budget.SetFuel(std::min<int64_t>(budget.GetFuel(), 0));
+    budget.AddFuel(fuel);
+
+    try
+    {
+        program->Resume();
+    }
+    catch(...)
+    {
+        budget.SetPausable(nullptr);
+        program.reset();
+
+        throw;
+    }
+
+    if(!program->IsFinished())
+        return {};
+
+    budget.SetPausable(nullptr);
+    program.reset();
+
+    return std::move(programResult);
+}
+
+Allocator& Interpreter::GetHeap()
+{
+    return allocator;
+}
+
+Budget& Interpreter::GetBudget()
+{
+    return budget;
+}
+
+void Interpreter::SetParallelism(const size_t threads)
+{
+    parallelism = threads;
+}
+
+Interpreter::Binding Interpreter::Bind()
+{
+    return { Context::Binding({ globals, &nodes, &allocator, &mappings, &budget, parallelism, tasks }), EventLoop::Binding(events) };
+}
+
+ValuePtr Interpreter::RunMain()
+{
+    auto result = programScope->Get("main")->Evaluate(programScope);
+
+    // Coroutines that nobody awaited still finish
+    events.Run();
+
+    // So do tasks that nobody joined
+    ThreadPool::Get().Wait(*tasks);
+
+    return result;
+}
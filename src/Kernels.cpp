@@ -0,0 +1,372 @@
+#include "Kernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+// Each kernel is compiled twice and the loader picks the AVX2 one when the CPU has it
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define KERNEL
+#endif
+
+#define KERNEL_INLINE __attribute__((always_inline)) inline
+
+namespace
+{
+
+// 32 bytes fill an AVX2 register, or two SSE ones on the baseline
+template<typename T>
+struct Vector;
+
+template<>
+struct Vector<int32_t> { typedef int32_t Type __attribute__((vector_size(32))); };
+
+template<>
+struct Vector<int64_t> { typedef int64_t Type __attribute__((vector_size(32))); };
+
+template<>
+struct Vector<float> { typedef float Type __attribute__((vector_size(32))); };
+
+template<>
+struct Vector<double> { typedef double Type __attribute__((vector_size(32))); };
+
+template<>
+struct Vector<uint8_t> { typedef uint8_t Type __attribute__((vector_size(32))); };
+
+template<typename T>
+using VectorOf = typename Vector<T>::Type;
+
+template<typename T>
+constexpr size_t lanes = sizeof(VectorOf<T>) / sizeof(T);
+
+// Integer sums are accumulated in 64-bit lanes, so they don't wrap around in the element type
+using WideVector = VectorOf<int64_t>;
+
+constexpr size_t wideLanes = lanes<int64_t>;
+
+// As many elements as the wide vector has lanes
+template<typename T>
+struct Narrow;
+
+template<>
+struct Narrow<int32_t> { typedef int32_t Type __attribute__((vector_size(wideLanes * sizeof(int32_t)))); };
+
+template<>
+struct Narrow<int64_t> { typedef int64_t Type __attribute__((vector_size(wideLanes * sizeof(int64_t)))); };
+
+template<>
+struct Narrow<uint8_t> { typedef uint8_t Type __attribute__((vector_size(wideLanes * sizeof(uint8_t)))); };
+
+// Vectors are passed by reference, so no vector crosses a call boundary
+template<typename T>
+KERNEL_INLINE void LoadVector(VectorOf<T>& vector, const T* data)
+{
+    std::memcpy(&vector, data, sizeof(vector));
+}
+
+template<typename T>
+KERNEL_INLINE void StoreVector(T* data, const VectorOf<T>& vector)
+{
+    std::memcpy(data, &vector, sizeof(vector));
+}
+
+template<typename T>
+KERNEL_INLINE void LoadWide(WideVector& vector, const T* data)
+{
+    typename Narrow<T>::Type narrow;
+    std::memcpy(&narrow, data, sizeof(narrow));
+
+    vector = __builtin_convertvector(narrow, WideVector);
+}
+
+template<typename T>
+KERNEL_INLINE auto SumOf(const T* data, const size_t size)
+{
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        VectorOf<T> accumulator{}, vector;
+        size_t i = 0;
+
+        for(; i + lanes<T> <= size; i += lanes<T>)
+        {
+            LoadVector(vector, data + i);
+            accumulator += vector;
+        }
+
+        T result{};
+        for(size_t lane = 0; lane < lanes<T>; lane++)
+            result += accumulator[lane];
+        for(; i < size; i++)
+            result += data[i];
+
+        return result;
+    }
+    else
+    {
+        WideVector accumulator{}, vector;
+        size_t i = 0;
+
+        for(; i + wideLanes <= size; i += wideLanes)
+        {
+            LoadWide(vector, data + i);
+            accumulator += vector;
+        }
+
+        int64_t result{};
+        for(size_t lane = 0; lane < wideLanes; lane++)
+            result += accumulator[lane];
+        for(; i < size; i++)
+            result += data[i];
+
+        return result;
+    }
+}
+
+template<bool isMin, typename T>
+KERNEL_INLINE T ExtremeOf(const T* data, const size_t size)
+{
+    T result = data[0];
+    size_t i = 0;
+
+    if(size >= lanes<T>)
+    {
+        VectorOf<T> accumulator, vector;
+        LoadVector(accumulator, data);
+
+        for(i = lanes<T>; i + lanes<T> <= size; i += lanes<T>)
+        {
+            LoadVector(vector, data + i);
+
+            if constexpr (isMin)
+                accumulator = vector < accumulator ? vector : accumulator;
+            else
+                accumulator = vector > accumulator ? vector : accumulator;
+        }
+
+        for(size_t lane = 0; lane < lanes<T>; lane++)
+            result = isMin ? std::min<T>(result, accumulator[lane]) : std::max<T>(result, accumulator[lane]);
+    }
+
+    for(; i < size; i++)
+        result = isMin ? std::min(result, data[i]) : std::max(result, data[i]);
+
+    return result;
+}
+
+template<typename T>
+KERNEL_INLINE auto DotOf(const T* left, const T* right, const size_t size)
+{
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        VectorOf<T> accumulator{}, l, r;
+        size_t i = 0;
+
+        for(; i + lanes<T> <= size; i += lanes<T>)
+        {
+            LoadVector(l, left + i);
+            LoadVector(r, right + i);
+            accumulator += l * r;
+        }
+
+        T result{};
+        for(size_t lane = 0; lane < lanes<T>; lane++)
+            result += accumulator[lane];
+        for(; i < size; i++)
+            result += left[i] * right[i];
+
+        return result;
+    }
+    else
+    {
+        WideVector accumulator{}, l, r;
+        size_t i = 0;
+
+        for(; i + wideLanes <= size; i += wideLanes)
+        {
+            LoadWide(l, left + i);
+            LoadWide(r, right + i);
+            accumulator += l * r;
+        }
+
+        int64_t result{};
+        for(size_t lane = 0; lane < wideLanes; lane++)
+            result += accumulator[lane];
+        for(; i < size; i++)
+            result += static_cast<int64_t>(left[i]) * right[i];
+
+        return result;
+    }
+}
+
+template<typename T>
+KERNEL_INLINE void ScaleOf(T* data, const size_t size, const T factor)
+{
+    VectorOf<T> vector;
+    size_t i = 0;
+
+    for(; i + lanes<T> <= size; i += lanes<T>)
+    {
+        LoadVector(vector, data + i);
+        vector *= factor;
+        StoreVector(data + i, vector);
+    }
+
+    for(; i < size; i++)
+        data[i] *= factor;
+}
+
+template<typename T>
+KERNEL_INLINE void AddOf(T* target, const T* source, const size_t size)
+{
+    VectorOf<T> t, s;
+    size_t i = 0;
+
+    for(; i + lanes<T> <= size; i += lanes<T>)
+    {
+        LoadVector(t, target + i);
+        LoadVector(s, source + i);
+        t += s;
+        StoreVector(target + i, t);
+    }
+
+    for(; i < size; i++)
+        target[i] += source[i];
+}
+
+// Integer results are read as int like the elements themselves, the ones that don't fit are errors
+template<typename T>
+Value ToValue(const T value)
+{
+    if constexpr (std::is_floating_point_v<T>)
+        return value;
+    else
+    {
+        if(!std::in_range<int>(value))
+            throw std::runtime_error(std::format("Integer result {} doesn't fit in an int", value));
+
+        return static_cast<int>(value);
+    }
+}
+
+void CheckPair(const PackedArray& left, const PackedArray& right)
+{
+    if(left.type != right.type)
+        throw std::runtime_error("Packed arrays have different element types");
+
+    if(left.size != right.size)
+        throw std::runtime_error("Packed arrays have different sizes");
+}
+
+}
+
+namespace Kernels
+{
+
+KERNEL Value Sum(const PackedArray& array)
+{
+    switch(array.type)
+    {
+    case PackedArray::Type::I32: return ToValue(SumOf(array.Data<int32_t>(), array.size));
+    case PackedArray::Type::I64: return ToValue(SumOf(array.Data<int64_t>(), array.size));
+    case PackedArray::Type::F32: return ToValue(SumOf(array.Data<float>(), array.size));
+    case PackedArray::Type::F64: return ToValue(SumOf(array.Data<double>(), array.size));
+    case PackedArray::Type::U8: return ToValue(SumOf(array.Data<uint8_t>(), array.size));
+    }
+
+    return 0;
+}
+
+KERNEL Value Min(const PackedArray& array)
+{
+    if(array.size == 0)
+        throw std::runtime_error("Packed array is empty");
+
+    switch(array.type)
+    {
+    case PackedArray::Type::I32: return ToValue(ExtremeOf<true>(array.Data<int32_t>(), array.size));
+    case PackedArray::Type::I64: return ToValue(ExtremeOf<true>(array.Data<int64_t>(), array.size));
+    case PackedArray::Type::F32: return ToValue(ExtremeOf<true>(array.Data<float>(), array.size));
+    case PackedArray::Type::F64: return ToValue(ExtremeOf<true>(array.Data<double>(), array.size));
+    case PackedArray::Type::U8: return ToValue(ExtremeOf<true>(array.Data<uint8_t>(), array.size));
+    }
+
+    return 0;
+}
+
+KERNEL Value Max(const PackedArray& array)
+{
+    if(array.size == 0)
+        throw std::runtime_error("Packed array is empty");
+
+    switch(array.type)
+    {
+    case PackedArray::Type::I32: return ToValue(ExtremeOf<false>(array.Data<int32_t>(), array.size));
+    case PackedArray::Type::I64: return ToValue(ExtremeOf<false>(array.Data<int64_t>(), array.size));
+    case PackedArray::Type::F32: return ToValue(ExtremeOf<false>(array.Data<float>(), array.size));
+    case PackedArray::Type::F64: return ToValue(ExtremeOf<false>(array.Data<double>(), array.size));
+    case PackedArray::Type::U8: return ToValue(ExtremeOf<false>(array.Data<uint8_t>(), array.size));
+    }
+
+    return 0;
+}
+
+KERNEL Value Dot(const PackedArray& left, const PackedArray& right)
+{
+    CheckPair(left, right);
+
+    switch(left.type)
+    {
+    case PackedArray::Type::I32: return ToValue(DotOf(left.Data<int32_t>(), right.Data<int32_t>(), left.size));
+    case PackedArray::Type::I64: return ToValue(DotOf(left.Data<int64_t>(), right.Data<int64_t>(), left.size));
+    case PackedArray::Type::F32: return ToValue(DotOf(left.Data<float>(), right.Data<float>(), left.size));
+    case PackedArray::Type::F64: return ToValue(DotOf(left.Data<double>(), right.Data<double>(), left.size));
+    case PackedArray::Type::U8: return ToValue(DotOf(left.Data<uint8_t>(), right.Data<uint8_t>(), left.size));
+    }
+
+    return 0;
+}
+
+KERNEL void Scale(const PackedArray& array, const Value& factor)
+{
+    switch(array.type)
+    {
+    case PackedArray::Type::I32: ScaleOf(array.MutableData<int32_t>(), array.size, ValueOp::ToNumber<int32_t>(factor)); break;
+    case PackedArray::Type::I64: ScaleOf(array.MutableData<int64_t>(), array.size, ValueOp::ToNumber<int64_t>(factor)); break;
+    case PackedArray::Type::F32: ScaleOf(array.MutableData<float>(), array.size, ValueOp::ToNumber<float>(factor)); break;
+    case PackedArray::Type::F64: ScaleOf(array.MutableData<double>(), array.size, ValueOp::ToNumber<double>(factor)); break;
+    case PackedArray::Type::U8: ScaleOf(array.MutableData<uint8_t>(), array.size, ValueOp::ToNumber<uint8_t>(factor)); break;
+    }
+}
+
+KERNEL void Add(const PackedArray& target, const PackedArray& source)
+{
+    CheckPair(target, source);
+
+    switch(target.type)
+    {
+    case PackedArray::Type::I32: AddOf(target.MutableData<int32_t>(), source.Data<int32_t>(), target.size); break;
+    case PackedArray::Type::I64: AddOf(target.MutableData<int64_t>(), source.Data<int64_t>(), target.size); break;
+    case PackedArray::Type::F32: AddOf(target.MutableData<float>(), source.Data<float>(), target.size); break;
+    case PackedArray::Type::F64: AddOf(target.MutableData<double>(), source.Data<double>(), target.size); break;
+    case PackedArray::Type::U8: AddOf(target.MutableData<uint8_t>(), source.Data<uint8_t>(), target.size); break;
+    }
+}
+
+void Fill(const PackedArray& array, const Value& value)
+{
+    // Plain fills are vectorized well by the standard library already
+    switch(array.type)
+    {
+    case PackedArray::Type::I32: std::fill_n(array.MutableData<int32_t>(), array.size, ValueOp::ToNumber<int32_t>(value)); break;
+    case PackedArray::Type::I64: std::fill_n(array.MutableData<int64_t>(), array.size, ValueOp::ToNumber<int64_t>(value)); break;
+    case PackedArray::Type::F32: std::fill_n(array.MutableData<float>(), array.size, ValueOp::ToNumber<float>(value)); break;
+    case PackedArray::Type::F64: std::fill_n(array.MutableData<double>(), array.size, ValueOp::ToNumber<double>(value)); break;
+    case PackedArray::Type::U8: std::fill_n(array.MutableData<uint8_t>(), array.size, ValueOp::ToNumber<uint8_t>(value)); break;
+    }
+}
+
+}
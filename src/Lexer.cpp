@@ -5,67 +5,132 @@
 #include <print>
 
 Lexer::Lexer(const std::filesystem::path& path)
-    : code(LoadCode(path))
+    : source(std::make_shared<const Source>(LoadCode(path), path.parent_path())),
+      position(source->code.begin()), end(source->code.end())
+{}
+
+Lexer::Lexer(const Location& begin, const size_t end)
+    : source(begin.source),
+      position(source->code.begin() + begin.offset), end(source->code.begin() + end)
+{}
+
+Lexer::Token Lexer::NextToken()
 {
-    std::filesystem::current_path(path.parent_path());
+    if(replayLexer)
+        return replayLexer->NextToken();
+
+    if(count == 0)
+        Fill();
+
+    auto token = std::move(buffer[head]);
+    location = std::move(locations[head]);
 
-    Tokenize();
+    head = (head + 1) % bufferSize;
+    count--;
 
-    current = tokens.begin();
+    return token;
 }
 
-Lexer::Token Lexer::NextToken()
+Lexer::Location Lexer::GetLocation() const
+{
+    return replayLexer ? replayLexer->GetLocation() : location;
+}
+
+void Lexer::Replay(const Location& begin, const size_t end)
+{
+    replayLexer.reset(new Lexer(begin, end));
+}
+
+void Lexer::EndReplay()
+{
+    replayLexer.reset();
+}
+
+void Lexer::Fill()
 {
-    return *current++;
+    while(count < bufferSize)
+    {
+        const auto index = (head + count++) % bufferSize;
+
+        auto& token = buffer[index];
+        token = Tokenize(locations[index]);
+
+        if(token.first == TokenType::EndOfFile)
+            break;
+    }
 }
 
-void Lexer::Tokenize()
+Lexer::Token Lexer::Tokenize(Location& location)
 {
-    for(auto i = code.begin(); i < code.end(); ++i)
+    if(importLexer)
     {
-        if(std::isspace(*i) || (comment && *i != '#'))
+        if(auto token = importLexer->NextToken(); token.first != TokenType::EndOfFile)
+        {
+            location = importLexer->GetLocation();
+            return token;
+        }
+
+        importLexer.reset();
+    }
+
+    for(; position < end; ++position)
+    {
+        if(std::isspace(*position) || (comment && *position != '#'))
             continue;
 
-        if(*i == '#')
+        if(*position == '#')
+        {
             comment = !comment;
-        else if(std::isalpha(*i) || *i == '_')
+            continue;
+        }
+
+        location = { source, static_cast<size_t>(position - source->code.begin()) };
+
+        Token token;
+
+        if(std::isalpha(*position) || *position == '_')
         {
-            tokens.emplace_back(ProcessIdentifier(i));
-            if(tokens.back().second == "import")
+            token = ProcessIdentifier(position);
+            if(token.second == "import")
             {
                 importFilename = true;
-                tokens.pop_back();
+                continue;
             }
         }
-        else if(std::isdigit(*i))
-            tokens.emplace_back(ProcessNumber(i));
-        else if(*i == '"')
+        else if(std::isdigit(*position))
+            token = ProcessNumber(position);
+        else if(*position == '"')
         {
-            tokens.emplace_back(ProcessString(i));
+            token = ProcessString(position);
             if(importFilename)
             {
-                Lexer importLexer(tokens.back().second);
+                importLexer = std::make_unique<Lexer>(source->directory / token.second);
+                importFilename = false;
 
-                tokens.reserve(tokens.size() + importLexer.tokens.size());
-                tokens.insert(tokens.end(), importLexer.tokens.begin(), importLexer.tokens.end());
+                ++position;
 
-                importFilename = false;
-                tokens.pop_back();
+                return Tokenize(location);
             }
         }
-        else if(*i == '\'')
+        else if(*position == '\'')
         {
-            tokens.emplace_back(Token{ TokenType::Char, { 1, ProcessChar(++i) } });
-            i += 1;
+            token = { TokenType::Char, { 1, ProcessChar(++position) } };
+            position += 1;
         }
         else
-            tokens.emplace_back(ProcessOperator(i));
+            token = ProcessOperator(position);
+
+        ++position;
+
+        return token;
     }
 
-    tokens.emplace_back(TokenType::EndOfFile, "");
+    location = { source, static_cast<size_t>(end - source->code.begin()) };
+
+    return { TokenType::EndOfFile, "" };
 }
 
-Lexer::Token Lexer::ProcessIdentifier(StringIter& iter) const
+Lexer::Token Lexer::ProcessIdentifier(StringIter& iter)
 {
     auto value = ""s;
 
@@ -111,28 +176,20 @@ Lexer::Token Lexer::ProcessString(StringIter& iter)
     return { TokenType::String, value };
 }
 
-Lexer::Token Lexer::ProcessOperator(const StringIter& iter)
+Lexer::Token Lexer::ProcessOperator(StringIter& iter) const
 {
     if(operatorTokensMap.contains(*iter))
     {
-        auto currentOp = operatorTokensMap.at(*iter);
-        if(tokens.empty())
-            return currentOp;
-
-        auto [type, string] = tokens.back();
-
-        if(type != TokenType::String && string.size() == 1)
+        if(iter + 1 < end)
         {
-            const auto p = std::pair{ string.at(0), currentOp.second.at(0) };
-
-            if(doubleTokensMap.contains(p))
+            if(const auto p = std::pair{ *iter, *(iter + 1) }; doubleTokensMap.contains(p))
             {
-                tokens.pop_back();
+                ++iter;
                 return doubleTokensMap.at(p);
             }
         }
 
-        return currentOp;
+        return operatorTokensMap.at(*iter);
     }
 
     return { TokenType::None, "" };
@@ -142,7 +199,7 @@ std::string Lexer::LoadCode(const std::filesystem::path& path)
 {
     std::ifstream file(path);
     if(!file.is_open())
-        throw std::runtime_error(std::format("Failed to open file {}. Current path: {}", path.string(), std::filesystem::current_path().string()));
+        throw std::runtime_error(std::format("Failed to open file {}", path.string()));
 
     std::string code;
     std::copy(
@@ -0,0 +1,105 @@
+#include "Output.hpp"
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+Output::Output()
+    : buffer(std::make_unique<char[]>(bufferSize)), lineBuffered(isatty(STDOUT_FILENO))
+{}
+
+Output::~Output()
+{
+    Flush();
+}
+
+void Output::Write(const std::string_view text)
+{
+    if(text.size() > bufferSize)
+    {
+        Flush();
+        std::fwrite(text.data(), 1, text.size(), stdout);
+        return;
+    }
+
+    Reserve(text.size());
+
+    std::memcpy(buffer.get() + size, text.data(), text.size());
+    size += text.size();
+
+    if(lineBuffered && text.find('\n') != std::string_view::npos)
+        Flush();
+}
+
+void Output::Write(const char c)
+{
+    Reserve(1);
+    buffer[size++] = c;
+
+    if(lineBuffered && c == '\n')
+        Flush();
+}
+
+void Output::WriteValue(const Value& value)
+{
+    std::visit([this](auto&& v)
+    {
+        using Type = std::decay_t<decltype(v)>;
+
+        if constexpr (std::is_same_v<Type, size_t>)
+        {
+            // Strings made with alloc keep one character per Value
+            for(auto pos = reinterpret_cast<const Value*>(v); pos; pos++)
+            {
+                const auto c = std::get_if<char>(pos);
+                if(!c || *c == '\0')
+                    break;
+
+                Write(*c);
+            }
+        }
+        else if constexpr (std::is_same_v<Type, String>)
+            Write(v.View());
+        else if constexpr (std::is_same_v<Type, bool>)
+            Write(v ? "true" : "false");
+        else if constexpr (std::is_same_v<Type, char>)
+            Write(v);
+        else if constexpr (std::is_same_v<Type, std::any> || std::is_same_v<Type, PackedArray>)
+            Write("Non printable");
+        else
+            WriteNumber(v);
+    }, value);
+}
+
+void Output::EndLine()
+{
+    Write('\n');
+}
+
+void Output::Flush()
+{
+    if(size > 0)
+        std::fwrite(buffer.get(), 1, size, stdout);
+
+    size = 0;
+    std::fflush(stdout);
+}
+
+template<typename T>
+void Output::WriteNumber(const T value)
+{
+    // Enough for any integer and the shortest representation of a double
+    constexpr size_t maxLength = 32;
+
+    Reserve(maxLength);
+
+    const auto [end, error] = std::to_chars(buffer.get() + size, buffer.get() + size + maxLength, value);
+    size = end - buffer.get();
+}
+
+void Output::Reserve(const size_t bytes)
+{
+    if(size + bytes > bufferSize)
+        Flush();
+}
@@ -1,6 +1,7 @@
 #include "Parser.hpp"
 
 #include <format>
+#include <optional>
 
 #include "Lexer.hpp"
 #include "NativeFunctions.hpp"
@@ -20,10 +21,100 @@ Parser::Parser(Lexer& lexer)
             statements.emplace_back(std::move(expr));
     }
 
-    root = std::make_shared<StatementList>(std::move(statements));
+    root = MakeNode<StatementList>(std::move(statements));
     std::static_pointer_cast<StatementList>(root)->noLocalScope = true;
 }
 
+Parser::RemovedCount Parser::RemoveUnused()
+{
+    auto& statements = std::static_pointer_cast<StatementList>(root)->statements;
+
+    std::unordered_map<std::string, ExprPtr> declarations;
+
+    for(const auto& i : statements)
+        if(const auto function = dynamic_cast<FunctionDecl*>(i.get()))
+            declarations[function->name] = i;
+
+    for(const auto& name : structs)
+        declarations[name] = globalScope->Get(name);
+
+    std::unordered_set<std::string> reachable;
+    std::vector<ExprPtr> pending;
+
+    auto reference = [&](const std::string& name)
+    {
+        if(declarations.contains(name) && reachable.insert(name).second)
+            pending.push_back(declarations[name]);
+    };
+
+    reference("main");
+
+    // Global variables might call something as well
+    for(const auto& i : statements)
+        if(!dynamic_cast<FunctionDecl*>(i.get()))
+            pending.push_back(i);
+
+    while(!pending.empty())
+    {
+        const auto node = std::move(pending.back());
+        pending.pop_back();
+
+        // Names are matched conservatively, so a method call keeps
+        // a function with the same name alive
+        if(const auto call = dynamic_cast<FunctionCall*>(node.get()))
+            reference(call->name);
+        else if(const auto constructor = dynamic_cast<ConstructorExpr*>(node.get()))
+            reference(constructor->name);
+        else if(const auto variable = dynamic_cast<VariableExpr*>(node.get()))
+            reference(variable->name);
+        else if(const auto flat = dynamic_cast<FlatExpr*>(node.get()))
+        {
+            std::ranges::for_each(flat->names, reference);
+
+            for(const auto& constant : flat->constants)
+                if(const auto string = std::get_if<String>(&constant))
+                    reference(std::string(string->View()));
+        }
+        // Bodies are only parsed when they are called, until then their identifiers are scanned
+        else if(const auto list = dynamic_cast<StatementList*>(node.get()))
+            list->ForEachName(reference);
+        // Functions can be named by strings as well, like the ones started by spawn
+        else if(const auto value = dynamic_cast<ValueExpr*>(node.get()))
+            if(const auto string = std::get_if<String>(value->value.get()))
+                reference(std::string(string->View()));
+
+        node->ForEachChild([&](const ExprPtr& child)
+        {
+            if(child)
+                pending.push_back(child);
+        });
+    }
+
+    RemovedCount removed;
+
+    std::erase_if(statements, [&](const ExprPtr& i)
+    {
+        const auto function = dynamic_cast<FunctionDecl*>(i.get());
+        return function && !reachable.contains(function->name) && ++removed.functions;
+    });
+
+    for(const auto& [name, node] : declarations)
+    {
+        if(dynamic_cast<StructDecl*>(node.get()) && !reachable.contains(name))
+        {
+            globalScope->symbols.erase(name);
+            removed.structs++;
+        }
+    }
+
+    return removed;
+}
+
+void Parser::OnBodyLoaded(std::function<void(StatementList&)> callback)
+{
+    bodyLoaded = std::move(callback);
+}
+
 ExprPtr Parser::GetRoot()
 {
     return std::move(root);
@@ -40,7 +131,24 @@ ExprPtr Parser::Parse()
     auto left = ParsePrimary();
     auto expr = ParseBinaryRight(0, std::move(left));
 
-    return std::move(expr);
+    return Flatten(std::move(expr));
+}
+
+ExprPtr Parser::Flatten(ExprPtr expr)
+{
+    const auto binary = dynamic_cast<BinaryExpr*>(expr.get());
+
+    // Members are looked up in the instance, so the right side of a dot is left as it is
+    if(!binary || binary->operation == Lexer::TokenType::Dot)
+        return expr;
+
+    if(auto flat = FlatExpr::Flatten(*binary))
+        return flat;
+
+    binary->left = Flatten(std::move(binary->left));
+    binary->right = Flatten(std::move(binary->right));
+
+    return expr;
 }
 
 ExprPtr Parser::ParsePrimary()
@@ -60,7 +168,7 @@ ExprPtr Parser::ParsePrimary()
 
     case Lexer::TokenType::Bool:
     {
-        auto expr = std::make_shared<ValueExpr>(currentToken.second == "true");
+        auto expr = MakeNode<ValueExpr>(currentToken.second == "true");
 
         NextToken();
 
@@ -88,7 +196,7 @@ ExprPtr Parser::ParseBinaryRight(const int leftPrec, ExprPtr left)
     if(currentToken.first == Lexer::TokenType::Increment
         || currentToken.first == Lexer::TokenType::Decrement)
     {
-        auto expr = std::make_shared<UnaryExpr>(currentToken, std::move(left));
+        auto expr = MakeNode<UnaryExpr>(currentToken.first, std::move(left));
         expr->operationFirst = false;
 
         NextToken();
@@ -104,7 +212,7 @@ ExprPtr Parser::ParseBinaryRight(const int leftPrec, ExprPtr left)
             auto index = Parse();
             Expect(Lexer::TokenType::RightBracket);
 
-            left = std::make_shared<IndexExpr>(std::move(left), std::move(index));
+            left = MakeNode<IndexExpr>(std::move(left), std::move(index));
 
             continue;
         }
@@ -114,7 +222,7 @@ ExprPtr Parser::ParseBinaryRight(const int leftPrec, ExprPtr left)
         if(currentPrec < leftPrec)
             return left;
 
-        auto operation = currentToken;
+        const auto operation = currentToken.first;
         NextToken();
 
         auto right = ParsePrimary();
@@ -122,7 +230,7 @@ ExprPtr Parser::ParseBinaryRight(const int leftPrec, ExprPtr left)
         if(const int nextPrec = GetPrecedence(); currentPrec < nextPrec)
             right = ParseBinaryRight(currentPrec + 1, std::move(right));
 
-        left = std::make_shared<BinaryExpr>(
+        left = MakeNode<BinaryExpr>(
             operation, std::move(left), std::move(right)
         );
     }
@@ -130,12 +238,12 @@ ExprPtr Parser::ParseBinaryRight(const int leftPrec, ExprPtr left)
 
 ExprPtr Parser::ParseUnary()
 {
-    auto operation = currentToken;
+    const auto operation = currentToken.first;
     NextToken();
 
     auto expr = ParsePrimary();
 
-    return std::make_shared<UnaryExpr>(operation, std::move(expr));
+    return MakeNode<UnaryExpr>(operation, std::move(expr));
 }
 
 ExprPtr Parser::ParseReserved()
@@ -150,23 +258,56 @@ ExprPtr Parser::ParseReserved()
         return ParseWhile();
     if(token == "for")
         return ParseFor();
+    if(token == "parfor")
+        return ParseFor(true);
     if(token == "return")
     {
         NextToken();
-        return std::make_shared<ReturnExpr>(Parse());
+        return MakeNode<ReturnExpr>(Parse());
     }
     if(token == "break")
     {
         NextToken();
-        return std::make_shared<BreakExpr>();
+        return MakeNode<BreakExpr>();
     }
     if(token == "continue")
     {
         NextToken();
-        return std::make_shared<ContinueExpr>();
+        return MakeNode<ContinueExpr>();
     }
     if(token == "struct")
         return ParseStruct();
+    if(token == "async")
+    {
+        NextToken();
+
+        if(currentToken.second != "fun")
+            throw std::runtime_error("async expects a function");
+
+        const auto function = ParseVarOrFunc(currentToken.second);
+        const auto body = std::static_pointer_cast<StatementList>(std::static_pointer_cast<FunctionDecl>(function)->body);
+
+        if(body->isGenerator)
+            throw std::runtime_error("Generators can't be async");
+
+        body->isAsync = true;
+
+        return function;
+    }
+    if(token == "yield")
+    {
+        NextToken();
+        return MakeNode<YieldExpr>(Parse());
+    }
+    if(token == "await")
+    {
+        NextToken();
+
+        // Binds tighter than the operators, so await f() + 1 adds to the result
+        auto expr = ParseBinaryRight(precedence.at(Lexer::TokenType::Dot), ParsePrimary());
+
+        return MakeNode<AwaitExpr>(std::move(expr));
+    }
 
     return nullptr;
 }
@@ -185,13 +326,13 @@ ExprPtr Parser::ParseIdentifier()
         {
             auto node = globalScope->Get(name).get();
             if(dynamic_cast<StructDecl*>(node))
-                return std::make_shared<ConstructorExpr>(std::move(name), std::move(args));
+                return MakeNode<ConstructorExpr>(std::move(name), std::move(args));
         }
 
-        return std::make_shared<FunctionCall>(std::move(name), std::move(args));
+        return MakeNode<FunctionCall>(std::move(name), std::move(args));
     }
 
-    return std::make_shared<VariableExpr>(name);
+    return MakeNode<VariableExpr>(name);
 }
 
 ExprPtr Parser::ParseNumber()
@@ -208,7 +349,7 @@ ExprPtr Parser::ParseNumber()
 
     NextToken();
 
-    return std::make_shared<ValueExpr>(value);
+    return MakeNode<ValueExpr>(value);
 }
 
 ExprPtr Parser::ParseString()
@@ -216,16 +357,7 @@ ExprPtr Parser::ParseString()
     const auto value = currentToken.second;
     NextToken();
 
-    std::vector<Value> data;
-    data.reserve(value.size() + 1);
-
-    for(const char i : value)
-        data.emplace_back(i);
-    data.emplace_back('\0');
-
-    dataSection.emplace_back(std::move(data));
-
-    return std::make_shared<ValueExpr>(reinterpret_cast<size_t>(dataSection.back().data()));
+    return MakeNode<ValueExpr>(String(value));
 }
 
 ExprPtr Parser::ParseChar()
@@ -233,7 +365,7 @@ ExprPtr Parser::ParseChar()
     auto value = currentToken.second;
     NextToken();
 
-    return std::make_shared<ValueExpr>(value[1]);
+    return MakeNode<ValueExpr>(value[1]);
 }
 
 ExprPtr Parser::ParseStatementList(const bool singleExpr)
@@ -254,7 +386,7 @@ ExprPtr Parser::ParseStatementList(const bool singleExpr)
     if(!singleExpr)
         Expect(Lexer::TokenType::RightBrace);
 
-    return std::make_shared<StatementList>(std::move(list));
+    return MakeNode<StatementList>(std::move(list));
 }
 
 std::vector<ExprPtr> Parser::ParseArguments()
@@ -286,21 +418,123 @@ ExprPtr Parser::ParseVarOrFunc(const std::string& token)
 
     if(token == "var")
     {
+        // var name[size] gets a buffer released with the scope, instead of alloc and free
+        if(currentToken.first == Lexer::TokenType::LeftBracket)
+        {
+            NextToken();
+            auto size = Parse();
+            Expect(Lexer::TokenType::RightBracket);
+
+            return MakeNode<ArrayDecl>(name, std::move(size));
+        }
+
         //globalScope->Declare(name, std::make_shared<ValueExpr>(0));
-        return std::make_shared<VariableDecl>(name, std::make_shared<ValueExpr>(Value(0)));
+        return MakeNode<VariableDecl>(name, MakeNode<ValueExpr>(Value(0)));
     }
 
     NextToken();
 
     auto args = ParseArguments();
+
+    if(currentToken.first == Lexer::TokenType::LeftBrace)
+    {
+        // Functions that yield anywhere in their body are generators
+        bool yields{};
+        auto body = MakeNode<StatementList>(SkipBody(yields), std::move(args));
+        body->isGenerator = yields;
+
+        return MakeNode<FunctionDecl>(name, std::move(body));
+    }
+
     const auto list = ParseStatementList(currentToken.first != Lexer::TokenType::LeftBrace);
 
-    return std::make_shared<FunctionDecl>(name, std::make_shared<StatementList>(
+    return MakeNode<FunctionDecl>(name, MakeNode<StatementList>(
         std::move(dynamic_cast<StatementList*>(list.get())->statements),
         std::move(args)
     ));
 }
 
+StatementList::DeferredBody Parser::SkipBody(bool& yields)
+{
+    // Only where the body is gets recorded, it is lexed again when it is parsed
+    const auto begin = lexer.GetLocation();
+    size_t end{};
+
+    int depth = 0;
+    do
+    {
+        if(currentToken.first == Lexer::TokenType::LeftBrace)
+            depth++;
+        else if(currentToken.first == Lexer::TokenType::RightBrace)
+            depth--;
+        else if(currentToken.first == Lexer::TokenType::EndOfFile)
+            throw std::runtime_error("Unexpected end of file in function body");
+        else if(currentToken.first == Lexer::TokenType::Reserved && currentToken.second == "yield")
+            yields = true;
+
+        end = lexer.GetLocation().offset + 1;
+        NextToken();
+    } while(depth > 0);
+
+    const auto parse = [this, begin, end]
+    {
+        const std::lock_guard lock(replayMutex);
+
+        return ParseBody(begin, end);
+    };
+
+    const auto forEachName = [this, begin, end](const StatementList::NameVisitor& visitor) { ScanNames(begin, end, visitor); };
+
+    const auto onLoad = [this](StatementList& body)
+    {
+        if(bodyLoaded)
+            bodyLoaded(body);
+    };
+
+    return { parse, forEachName, onLoad };
+}
+
+void Parser::ScanNames(const Lexer::Location& begin, const size_t end, const StatementList::NameVisitor& visitor)
+{
+    const std::lock_guard lock(replayMutex);
+
+    lexer.Replay(begin, end);
+
+    // Strings count too, as functions can be named by them
+    for(auto token = lexer.NextToken(); token.first != Lexer::TokenType::EndOfFile; token = lexer.NextToken())
+        if(token.first == Lexer::TokenType::Identifier || token.first == Lexer::TokenType::String)
+            visitor(token.second);
+
+    lexer.EndReplay();
+}
+
+std::vector<ExprPtr> Parser::ParseBody(const Lexer::Location& begin, const size_t end)
+{
+    const auto savedToken = currentToken;
+
+    lexer.Replay(begin, end);
+    currentToken = {};
+
+    try
+    {
+        NextToken();
+
+        const auto list = ParseStatementList();
+
+        lexer.EndReplay();
+        currentToken = savedToken;
+
+        return std::move(std::static_pointer_cast<StatementList>(list)->statements);
+    }
+    catch(...)
+    {
+        lexer.EndReplay();
+        currentToken = savedToken;
+
+        throw;
+    }
+}
+
 ExprPtr Parser::ParseIf()
 {
     NextToken();
@@ -323,7 +557,7 @@ ExprPtr Parser::ParseIf()
             elseExpr = ParseStatementList(currentToken.first != Lexer::TokenType::LeftBrace);
     }
 
-    return std::make_shared<IfStatement>(std::move(condition), std::move(then), std::move(elseExpr));
+    return MakeNode<IfStatement>(std::move(condition), std::move(then), std::move(elseExpr));
 }
 
 ExprPtr Parser::ParseWhile()
@@ -337,10 +571,10 @@ ExprPtr Parser::ParseWhile()
 
     auto body = ParseStatementList(currentToken.first != Lexer::TokenType::LeftBrace);
 
-    return std::make_shared<WhileStatement>(std::move(condition), std::move(body));
+    return MakeNode<WhileStatement>(std::move(condition), std::move(body));
 }
 
-ExprPtr Parser::ParseFor()
+ExprPtr Parser::ParseFor(const bool parallel)
 {
     NextToken();
     Expect(Lexer::TokenType::LeftParen);
@@ -349,11 +583,26 @@ ExprPtr Parser::ParseFor()
     if(currentToken.first != Lexer::TokenType::Semicolon)
         init = Parse();
 
+    // for(var name in generator) takes the values of a generator instead of counting
+    if(const auto variable = dynamic_cast<VariableDecl*>(init.get()); variable && !parallel
+        && currentToken.first == Lexer::TokenType::Identifier && currentToken.second == "in")
+    {
+        NextToken();
+        auto iterable = Parse();
+
+        Expect(Lexer::TokenType::RightParen);
+
+        auto body = ParseStatementList(currentToken.first != Lexer::TokenType::LeftBrace);
+
+        return MakeNode<ForInStatement>(variable->name, std::move(iterable), std::move(body));
+    }
+
     Expect(Lexer::TokenType::Semicolon);
 
+    // parfor reads the counter and the end from the condition, so it stays a tree
     ExprPtr condition{};
     if(currentToken.first != Lexer::TokenType::Semicolon)
-        condition = Parse();
+        condition = parallel ? ParseBinaryRight(0, ParsePrimary()) : Parse();
 
     Expect(Lexer::TokenType::Semicolon);
 
@@ -363,10 +612,53 @@ ExprPtr Parser::ParseFor()
 
     Expect(Lexer::TokenType::RightParen);
 
+    // The body gets its own scope on every iteration, so locals don't pile up
     auto body = ParseStatementList(currentToken.first != Lexer::TokenType::LeftBrace);
-    std::static_pointer_cast<StatementList>(body)->noLocalScope = true;
 
-    return std::make_shared<ForStatement>(
+    if(parallel)
+    {
+        // Only counting loops can be split: parfor(var i = begin; i < end; i++)
+        const auto error = std::runtime_error("parfor expects (var i = begin; i < end; i++)");
+
+        const auto initExpr = dynamic_cast<BinaryExpr*>(init.get());
+        if(!initExpr || initExpr->operation != Lexer::TokenType::Equal)
+            throw error;
+
+        const auto counter = dynamic_cast<VariableDecl*>(initExpr->left.get());
+        if(!counter)
+            throw error;
+
+        const auto isCounter = [&](const ExprPtr& expr)
+        {
+            const auto variable = dynamic_cast<VariableExpr*>(expr.get());
+            return variable && variable->name == counter->name;
+        };
+
+        const auto conditionExpr = dynamic_cast<BinaryExpr*>(condition.get());
+        if(!conditionExpr || !isCounter(conditionExpr->left)
+            || (conditionExpr->operation != Lexer::TokenType::Less && conditionExpr->operation != Lexer::TokenType::LessEqual))
+            throw error;
+
+        const auto increment = dynamic_cast<UnaryExpr*>(step.get());
+        const auto addition = dynamic_cast<BinaryExpr*>(step.get());
+        const auto stepValue = addition ? dynamic_cast<ValueExpr*>(addition->right.get()) : nullptr;
+        const auto stepSize = stepValue ? std::get_if<int>(stepValue->value.get()) : nullptr;
+
+        if(!(increment && increment->operation == Lexer::TokenType::Increment && isCounter(increment->expr))
+            && !(addition && addition->operation == Lexer::TokenType::AddAssign && isCounter(addition->left)
+                && stepSize && *stepSize == 1))
+            throw error;
+
+        auto end = conditionExpr->right;
+        if(conditionExpr->operation == Lexer::TokenType::LessEqual)
+            end = MakeNode<BinaryExpr>(Lexer::TokenType::Plus, std::move(end), MakeNode<ValueExpr>(Value(1)));
+
+        end = Flatten(std::move(end));
+
+        return MakeNode<ParallelForStatement>(counter->name, initExpr->right, std::move(end), std::move(body));
+    }
+
+    return MakeNode<ForStatement>(
         std::move(init), std::move(condition),
         std::move(step), std::move(body)
     );
@@ -378,7 +670,7 @@ ExprPtr Parser::ParseStruct()
     const auto name = currentToken.second;
     NextToken();
 
-    auto structDecl = std::make_shared<StructDecl>(name);
+    auto structDecl = MakeNode<StructDecl>(name);
 
     Expect(Lexer::TokenType::LeftBrace);
 
@@ -386,17 +678,30 @@ ExprPtr Parser::ParseStruct()
     {
         const auto token = currentToken.second;
         auto expr = ParseVarOrFunc(token);
-        auto propertyName = std::static_pointer_cast<VariableDecl>(expr)->name;
+        std::string propertyName;
 
         // Only variables are being ordered
-        if(dynamic_cast<VariableDecl*>(expr.get()))
+        if(const auto variable = dynamic_cast<VariableDecl*>(expr.get()))
+        {
+            propertyName = variable->name;
             structDecl->order.push_back(propertyName);
+        }
+        else if(const auto array = dynamic_cast<ArrayDecl*>(expr.get()))
+        {
+            propertyName = array->name;
+            structDecl->arrays.push_back(propertyName);
+        }
+        else
+        {
+            propertyName = std::static_pointer_cast<FunctionDecl>(expr)->name;
+        }
 
         structDecl->content[propertyName] = std::move(expr);
     }
 
     NextToken();
 
+    structs.push_back(name);
     globalScope->Declare(name, std::move(structDecl));
 
     return structDecl;
@@ -0,0 +1,137 @@
+#include "Reader.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "Output.hpp"
+
+Reader::Reader(const int fd)
+    : fd(fd), buffer(std::make_unique<char[]>(blockSize))
+{}
+
+String Reader::ReadLine()
+{
+    std::lock_guard lock(mutex);
+
+    size_t scanned = begin;
+
+    while(true)
+    {
+        if(const auto newline = static_cast<char*>(std::memchr(buffer.get() + scanned, '\n', end - scanned)))
+        {
+            const auto size = newline - (buffer.get() + begin);
+            String line(Take(size));
+            begin++;
+
+            return line;
+        }
+
+        // Fill moves the unread bytes to the front, the scanned ones aren't searched again
+        scanned = end - begin;
+
+        if(!Fill())
+            return String(Take(end - begin));
+
+        scanned += begin;
+    }
+}
+
+String Reader::ReadChunk(const size_t size)
+{
+    std::lock_guard lock(mutex);
+
+    if(begin == end)
+        Fill();
+
+    return String(Take(std::min(size, end - begin)));
+}
+
+String Reader::ReadAll()
+{
+    std::lock_guard lock(mutex);
+
+    while(Fill()) {}
+
+    return String(Take(end - begin));
+}
+
+String Reader::ReadExact(const size_t size)
+{
+    std::lock_guard lock(mutex);
+
+    while(end - begin < size)
+        if(!Fill())
+            throw std::runtime_error("Unexpected end of input");
+
+    return String(Take(size));
+}
+
+bool Reader::Eof()
+{
+    std::lock_guard lock(mutex);
+
+    return begin == end && !Fill();
+}
+
+const std::shared_ptr<Reader>& Reader::Stdin()
+{
+    static const auto reader = std::make_shared<Reader>(STDIN_FILENO);
+    return reader;
+}
+
+bool Reader::Fill()
+{
+    if(finished)
+        return false;
+
+    // Unread bytes move to the front, the buffer only grows for lines longer than it
+    if(begin > 0)
+    {
+        std::memmove(buffer.get(), buffer.get() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+    }
+
+    if(capacity - end < blockSize / 2)
+    {
+        capacity *= 2;
+
+        auto grown = std::make_unique<char[]>(capacity);
+        std::memcpy(grown.get(), buffer.get(), end);
+        buffer = std::move(grown);
+    }
+
+    // Prompts without a newline should be visible before waiting for input
+    if(fd == STDIN_FILENO)
+        console.Flush();
+
+    ssize_t count;
+    do
+        count = read(fd, buffer.get() + end, capacity - end);
+    while(count < 0 && errno == EINTR);
+
+    if(count < 0)
+        throw std::runtime_error(std::format("Read failed: {}", std::strerror(errno)));
+
+    if(count == 0)
+    {
+        finished = true;
+        return false;
+    }
+
+    end += count;
+
+    return true;
+}
+
+std::string_view Reader::Take(const size_t size)
+{
+    const std::string_view taken(buffer.get() + begin, size);
+    begin += size;
+
+    return taken;
+}
@@ -0,0 +1,352 @@
+#include "Serializer.hpp"
+
+#include <format>
+
+#include "Allocator.hpp"
+
+std::string Serializer::Save(const Value& value)
+{
+    Begin();
+    WriteValue(value);
+
+    return Finish();
+}
+
+std::string Serializer::Save(const Value* values, const size_t count)
+{
+    if(count == 0)
+        throw std::runtime_error("Invalid element count");
+
+    Begin();
+
+    Write(Tag::Buffer);
+    WriteVarint(count);
+
+    for(size_t i = 0; i < count; i++)
+        WriteValue(values[i]);
+
+    return Finish();
+}
+
+Value Serializer::Load(const std::string_view record, const ScopePtr& scope)
+{
+    if(record.size() < headerSize || BodySize(record) != record.size() - headerSize)
+        throw std::runtime_error("Truncated serialized value");
+
+    return LoadBody(record.substr(headerSize), scope);
+}
+
+Value Serializer::LoadBody(const std::string_view body, const ScopePtr& scope)
+{
+    input = body;
+    this->scope = scope;
+
+    auto value = ReadValue();
+
+    if(!input.empty())
+        throw std::runtime_error("Trailing bytes after serialized value");
+
+    return value;
+}
+
+size_t Serializer::BodySize(const std::string_view header)
+{
+    uint32_t recordMagic;
+    uint64_t size;
+
+    std::memcpy(&recordMagic, header.data(), sizeof(recordMagic));
+    std::memcpy(&size, header.data() + sizeof(recordMagic), sizeof(size));
+
+    if(recordMagic != magic)
+        throw std::runtime_error("Not a serialized value");
+
+    return size;
+}
+
+void Serializer::Begin()
+{
+    output.clear();
+    output.resize(headerSize);
+}
+
+std::string Serializer::Finish()
+{
+    const uint64_t size = output.size() - headerSize;
+
+    std::memcpy(output.data(), &magic, sizeof(magic));
+    std::memcpy(output.data() + sizeof(magic), &size, sizeof(size));
+
+    return std::move(output);
+}
+
+void Serializer::WriteValue(const Value& value)
+{
+    std::visit([this](auto&& v)
+    {
+        using Type = std::decay_t<decltype(v)>;
+
+        if constexpr (std::is_same_v<Type, int>)
+        {
+            // Zigzag keeps small negative numbers short
+            Write(Tag::Int);
+            WriteVarint((static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31));
+        }
+        else if constexpr (std::is_same_v<Type, float>)
+        {
+            Write(Tag::Float);
+            Write(v);
+        }
+        else if constexpr (std::is_same_v<Type, double>)
+        {
+            Write(Tag::Double);
+            Write(v);
+        }
+        else if constexpr (std::is_same_v<Type, bool>)
+        {
+            Write(Tag::Bool);
+            Write(v);
+        }
+        else if constexpr (std::is_same_v<Type, char>)
+        {
+            Write(Tag::Char);
+            Write(v);
+        }
+        else if constexpr (std::is_same_v<Type, String>)
+        {
+            Write(Tag::String);
+            WriteBytes(v.View());
+        }
+        else if constexpr (std::is_same_v<Type, PackedArray>)
+        {
+            Write(Tag::Packed);
+            Write(v.type);
+            WriteBytes({ v.template Data<char>(), v.size * v.ElementSize() });
+        }
+        else if constexpr (std::is_same_v<Type, size_t>)
+            throw std::runtime_error("Pointers can't be serialized, serialize the buffer with its element count");
+        else
+        {
+            StructInstancePtr instance;
+            if(const auto strong = std::any_cast<StructInstancePtr>(&v))
+                instance = *strong;
+            else if(const auto weak = std::any_cast<std::weak_ptr<StructInstance>>(&v))
+                instance = weak->lock();
+
+            if(!instance)
+                throw std::runtime_error("Only numbers, strings, packed arrays and structures can be serialized");
+
+            WriteStruct(*instance);
+        }
+    }, value);
+}
+
+void Serializer::WriteStruct(const StructInstance& instance)
+{
+    const auto structDecl = dynamic_cast<StructDecl*>(globalScope->Get(instance.name).get());
+    if(!structDecl || structDecl->nativeInit)
+        throw std::runtime_error(std::format("'{}' instances can't be serialized", instance.name));
+
+    if(++depth > maxDepth)
+        throw std::runtime_error("Structures are nested too deeply to serialize");
+
+    Write(Tag::Struct);
+    WriteBytes(instance.name);
+    WriteVarint(structDecl->order.size());
+
+    for(const auto& field : structDecl->order)
+        WriteValue(*instance.localScope->Get(field)->Evaluate(instance.localScope));
+
+    WriteArrays(*structDecl, instance);
+
+    depth--;
+}
+
+void Serializer::WriteArrays(const StructDecl& structDecl, const StructInstance& instance)
+{
+    WriteVarint(structDecl.arrays.size());
+
+    for(const auto& name : structDecl.arrays)
+    {
+        const auto count = ArraySize(structDecl, name);
+        const auto elements = reinterpret_cast<const Value*>(
+            std::get<size_t>(*instance.localScope->Get(name)->Evaluate(instance.localScope))
+        );
+
+        WriteVarint(count);
+
+        for(size_t i = 0; i < count; i++)
+            WriteValue(elements[i]);
+    }
+}
+
+void Serializer::WriteVarint(uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        output.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+
+    output.push_back(static_cast<char>(value));
+}
+
+void Serializer::WriteBytes(const std::string_view bytes)
+{
+    WriteVarint(bytes.size());
+    output.append(bytes);
+}
+
+Value Serializer::ReadValue()
+{
+    switch(Read<Tag>())
+    {
+    case Tag::Int:
+    {
+        const auto zigzag = static_cast<uint32_t>(ReadVarint());
+        return static_cast<int>((zigzag >> 1) ^ -(zigzag & 1));
+    }
+    case Tag::Float: return Read<float>();
+    case Tag::Double: return Read<double>();
+    case Tag::Bool: return Read<uint8_t>() != 0;
+    case Tag::Char: return Read<char>();
+    case Tag::String: return String(ReadBytes(ReadVarint()));
+    case Tag::Packed:
+    {
+        PackedArray array{ nullptr, 0, Read<PackedArray::Type>() };
+
+        const auto bytes = ReadBytes(ReadVarint());
+        if(array.ElementSize() == 0 || bytes.size() % array.ElementSize() != 0)
+            throw std::runtime_error("Corrupted packed array");
+
+        array.size = static_cast<uint32_t>(bytes.size() / array.ElementSize());
+        if(array.size == 0)
+            return array;
+
+        array.data = heap->Allocate(bytes.size());
+        if(!array.data)
+            throw std::runtime_error("Memory allocation failed");
+
+        std::memcpy(array.data, bytes.data(), bytes.size());
+
+        return array;
+    }
+    case Tag::Struct: return ReadStruct();
+    case Tag::Buffer: return ReadBuffer();
+    }
+
+    throw std::runtime_error("Corrupted serialized value");
+}
+
+Value Serializer::ReadStruct()
+{
+    const std::string name(ReadBytes(ReadVarint()));
+
+    const auto structDecl = dynamic_cast<StructDecl*>(scope->Get(name).get());
+    if(!structDecl || structDecl->nativeInit)
+        throw std::runtime_error(std::format("'{}' is not a struct that can be deserialized", name));
+
+    if(ReadVarint() != structDecl->order.size())
+        throw std::runtime_error(std::format("Struct '{}' changed since it was serialized", name));
+
+    if(++depth > maxDepth)
+        throw std::runtime_error("Structures are nested too deeply to deserialize");
+
+    auto instance = ConstructorExpr::Instantiate(*structDecl, name, std::pmr::polymorphic_allocator<>());
+
+    for(const auto& field : structDecl->order)
+        instance->localScope->Get(field) = std::make_shared<ValueExpr>(ReadValue());
+
+    ReadArrays(*structDecl, *instance);
+
+    depth--;
+
+    return std::any(std::move(instance));
+}
+
+void Serializer::ReadArrays(const StructDecl& structDecl, const StructInstance& instance)
+{
+    if(ReadVarint() != structDecl.arrays.size())
+        throw std::runtime_error(std::format("Struct '{}' changed since it was serialized", structDecl.name));
+
+    // The new instance has its arrays already, the elements are read into them
+    for(const auto& name : structDecl.arrays)
+    {
+        const auto count = ArraySize(structDecl, name);
+        if(ReadVarint() != count)
+            throw std::runtime_error(std::format("Struct '{}' changed since it was serialized", structDecl.name));
+
+        const auto elements = reinterpret_cast<Value*>(
+            std::get<size_t>(*instance.localScope->Get(name)->Evaluate(instance.localScope))
+        );
+
+        for(size_t i = 0; i < count; i++)
+            elements[i] = ReadValue();
+    }
+}
+
+size_t Serializer::ArraySize(const StructDecl& structDecl, const std::string& name)
+{
+    const auto arrayDecl = dynamic_cast<const ArrayDecl*>(structDecl.content.at(name).get());
+    const auto size = arrayDecl ? dynamic_cast<const ValueExpr*>(arrayDecl->size.get()) : nullptr;
+    if(!size)
+        throw std::runtime_error(std::format("Array '{}' of '{}' has no fixed size, so it can't be serialized", name, structDecl.name));
+
+    return std::get<int>(*size->value);
+}
+
+Value Serializer::ReadBuffer()
+{
+    const auto count = ReadVarint();
+
+    // Every element takes at least its tag, so corrupted counts don't allocate huge buffers
+    if(count == 0 || count > input.size())
+        throw std::runtime_error("Corrupted buffer");
+
+    const auto values = static_cast<Value*>(heap->Allocate(count * sizeof(Value)));
+    if(!values)
+        throw std::runtime_error("Memory allocation failed");
+
+    size_t i = 0;
+
+    try
+    {
+        for(; i < count; i++)
+            std::construct_at(values + i, ReadValue());
+    }
+    catch(...)
+    {
+        std::destroy_n(values, i);
+        heap->Free(values);
+
+        throw;
+    }
+
+    return reinterpret_cast<size_t>(values);
+}
+
+uint64_t Serializer::ReadVarint()
+{
+    uint64_t value{};
+
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        const auto byte = Read<uint8_t>();
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+        if(!(byte & 0x80))
+            return value;
+    }
+
+    throw std::runtime_error("Corrupted varint");
+}
+
+std::string_view Serializer::ReadBytes(const size_t size)
+{
+    if(size > input.size())
+        throw std::runtime_error("Truncated serialized value");
+
+    const auto bytes = input.substr(0, size);
+    input.remove_prefix(size);
+
+    return bytes;
+}
@@ -0,0 +1,493 @@
+#include "Snapshot.hpp"
+
+#include <format>
+
+void Snapshot::Save(const std::filesystem::path& path, const ScopePtr& programScope)
+{
+    output.open(path, std::ios::binary);
+    if(!output.is_open())
+        throw std::runtime_error(std::format("Failed to create snapshot {}", path.string()));
+
+    Write(magic);
+    Write(version);
+
+    std::vector<std::pair<std::string, ExprPtr>> structs;
+    for(const auto& [name, node] : globalScope->symbols)
+        if(dynamic_cast<StructDecl*>(node.get()) && !IsNative(node))
+            structs.emplace_back(name, node);
+
+    Write<uint32_t>(structs.size());
+    for(const auto& [name, node] : structs)
+    {
+        WriteString(name);
+        WriteNode(node);
+    }
+
+    // Symbols cached from the global scope are found again at runtime
+    std::vector<std::pair<std::string, ExprPtr>> symbols;
+    for(const auto& [name, node] : programScope->symbols)
+    {
+        const auto global = globalScope->symbols.find(name);
+        if(!IsNative(node) && (global == globalScope->symbols.end() || global->second != node))
+            symbols.emplace_back(name, node);
+    }
+
+    Write<uint32_t>(symbols.size());
+    for(const auto& [name, node] : symbols)
+    {
+        WriteString(name);
+        WriteNode(node);
+    }
+
+    output.close();
+}
+
+void Snapshot::Load(const std::filesystem::path& path, const ScopePtr& programScope)
+{
+    input.open(path, std::ios::binary);
+    if(!input.is_open())
+        throw std::runtime_error(std::format("Failed to open snapshot {}", path.string()));
+
+    if(Read<uint32_t>() != magic || Read<uint32_t>() != version)
+        throw std::runtime_error(std::format("{} is not a compatible snapshot", path.string()));
+
+    for(auto count = Read<uint32_t>(); count > 0; count--)
+    {
+        auto name = ReadString();
+        globalScope->Declare(name, ReadNode());
+    }
+
+    for(auto count = Read<uint32_t>(); count > 0; count--)
+    {
+        auto name = ReadString();
+        programScope->Declare(name, ReadNode());
+    }
+
+    input.close();
+}
+
+bool Snapshot::IsNative(const ExprPtr& node)
+{
+    if(dynamic_cast<UndefinedExpr*>(node.get()))
+        return true;
+
+    if(const auto list = dynamic_cast<StatementList*>(node.get()))
+        return static_cast<bool>(list->nativeFunc);
+
+    if(const auto structDecl = dynamic_cast<StructDecl*>(node.get()))
+    {
+        if(structDecl->nativeInit)
+            return true;
+
+        for(const auto& value : structDecl->content | std::views::values)
+            if(const auto function = dynamic_cast<FunctionDecl*>(value.get()); function && IsNative(function->body))
+                return true;
+    }
+
+    return false;
+}
+
+void Snapshot::WriteNode(const ExprPtr& node)
+{
+    const auto expr = node.get();
+
+    if(!expr)
+        Write(NodeType::None);
+    else if(const auto value = dynamic_cast<ValueExpr*>(expr))
+    {
+        Write(NodeType::Value);
+        WriteValue(*value->value);
+    }
+    else if(const auto variable = dynamic_cast<VariableExpr*>(expr))
+    {
+        Write(NodeType::Variable);
+        WriteString(variable->name);
+    }
+    else if(const auto variableDecl = dynamic_cast<VariableDecl*>(expr))
+    {
+        Write(NodeType::VariableDecl);
+        WriteString(variableDecl->name);
+        WriteNode(variableDecl->value);
+    }
+    else if(const auto arrayDecl = dynamic_cast<ArrayDecl*>(expr))
+    {
+        Write(NodeType::ArrayDecl);
+        WriteString(arrayDecl->name);
+        WriteNode(arrayDecl->size);
+    }
+    else if(const auto returnExpr = dynamic_cast<ReturnExpr*>(expr))
+    {
+        Write(NodeType::Return);
+        WriteNode(returnExpr->value);
+    }
+    else if(dynamic_cast<BreakExpr*>(expr))
+        Write(NodeType::Break);
+    else if(dynamic_cast<ContinueExpr*>(expr))
+        Write(NodeType::Continue);
+    else if(const auto list = dynamic_cast<StatementList*>(expr))
+    {
+        if(list->nativeFunc)
+            throw std::runtime_error("Native functions can't be saved to a snapshot");
+
+        list->LoadBody();
+
+        Write(NodeType::StatementList);
+        Write(list->noLocalScope);
+        Write(list->isAsync);
+        Write(list->isGenerator);
+        WriteNodes(list->args);
+        WriteNodes(list->statements);
+    }
+    else if(const auto function = dynamic_cast<FunctionDecl*>(expr))
+    {
+        Write(NodeType::FunctionDecl);
+        WriteString(function->name);
+        WriteNode(function->body);
+    }
+    else if(const auto structDecl = dynamic_cast<StructDecl*>(expr))
+    {
+        Write(NodeType::StructDecl);
+        WriteString(structDecl->name);
+
+        Write<uint32_t>(structDecl->content.size());
+        for(const auto& [name, value] : structDecl->content)
+        {
+            WriteString(name);
+            WriteNode(value);
+        }
+
+        Write<uint32_t>(structDecl->order.size());
+        for(const auto& name : structDecl->order)
+            WriteString(name);
+
+        Write<uint32_t>(structDecl->arrays.size());
+        for(const auto& name : structDecl->arrays)
+            WriteString(name);
+    }
+    else if(const auto constructor = dynamic_cast<ConstructorExpr*>(expr))
+    {
+        Write(NodeType::Constructor);
+        WriteString(constructor->name);
+        WriteNodes(constructor->args);
+    }
+    else if(const auto ifStatement = dynamic_cast<IfStatement*>(expr))
+    {
+        Write(NodeType::If);
+        WriteNode(ifStatement->condition);
+        WriteNode(ifStatement->then);
+        WriteNode(ifStatement->elseExpr);
+    }
+    else if(const auto whileStatement = dynamic_cast<WhileStatement*>(expr))
+    {
+        Write(NodeType::While);
+        WriteNode(whileStatement->condition);
+        WriteNode(whileStatement->body);
+    }
+    else if(const auto forStatement = dynamic_cast<ForStatement*>(expr))
+    {
+        Write(NodeType::For);
+        WriteNode(forStatement->init);
+        WriteNode(forStatement->condition);
+        WriteNode(forStatement->step);
+        WriteNode(forStatement->body);
+    }
+    else if(const auto parallelFor = dynamic_cast<ParallelForStatement*>(expr))
+    {
+        Write(NodeType::ParallelFor);
+        WriteString(parallelFor->name);
+        WriteNode(parallelFor->begin);
+        WriteNode(parallelFor->end);
+        WriteNode(parallelFor->body);
+    }
+    else if(const auto forIn = dynamic_cast<ForInStatement*>(expr))
+    {
+        Write(NodeType::ForIn);
+        WriteString(forIn->name);
+        WriteNode(forIn->iterable);
+        WriteNode(forIn->body);
+    }
+    else if(const auto yield = dynamic_cast<YieldExpr*>(expr))
+    {
+        Write(NodeType::Yield);
+        WriteNode(yield->value);
+    }
+    else if(const auto await = dynamic_cast<AwaitExpr*>(expr))
+    {
+        Write(NodeType::Await);
+        WriteNode(await->expr);
+    }
+    else if(const auto call = dynamic_cast<FunctionCall*>(expr))
+    {
+        Write(NodeType::FunctionCall);
+        WriteString(call->name);
+        WriteNodes(call->args);
+    }
+    else if(const auto index = dynamic_cast<IndexExpr*>(expr))
+    {
+        Write(NodeType::Index);
+        WriteNode(index->expr);
+        WriteNode(index->index);
+    }
+    else if(const auto unary = dynamic_cast<UnaryExpr*>(expr))
+    {
+        Write(NodeType::Unary);
+        Write(unary->operation);
+        Write(unary->operationFirst);
+        WriteNode(unary->expr);
+    }
+    else if(const auto binary = dynamic_cast<BinaryExpr*>(expr))
+    {
+        Write(NodeType::Binary);
+        Write(binary->operation);
+        WriteNode(binary->left);
+        WriteNode(binary->right);
+    }
+    else if(const auto flat = dynamic_cast<FlatExpr*>(expr))
+    {
+        Write(NodeType::Flat);
+
+        Write(static_cast<uint32_t>(flat->nodes.size()));
+        for(const auto& [kind, operation, left, right] : flat->nodes)
+        {
+            Write(kind);
+            Write(operation);
+            Write(left);
+            Write(right);
+        }
+
+        Write(static_cast<uint32_t>(flat->constants.size()));
+        for(const auto& constant : flat->constants)
+            WriteValue(constant);
+
+        Write(static_cast<uint32_t>(flat->names.size()));
+        for(const auto& name : flat->names)
+            WriteString(name);
+    }
+    else
+        throw std::runtime_error("Expression can't be saved to a snapshot");
+}
+
+void Snapshot::WriteNodes(const std::vector<ExprPtr>& nodes)
+{
+    Write<uint32_t>(nodes.size());
+    for(const auto& i : nodes)
+        WriteNode(i);
+}
+
+void Snapshot::WriteValue(const Value& value)
+{
+    Write<uint8_t>(value.index());
+
+    std::visit([this](auto&& v)
+    {
+        using Type = std::decay_t<decltype(v)>;
+
+        if constexpr (std::is_same_v<Type, std::any>)
+            throw std::runtime_error("Structure instances can't be saved to a snapshot");
+        else if constexpr (std::is_same_v<Type, size_t>)
+        {
+            // Only null pointers mean the same thing in the next run
+            if(v != 0)
+                throw std::runtime_error("Heap pointers can't be saved to a snapshot");
+
+            Write(v);
+        }
+        else if constexpr (std::is_same_v<Type, String>)
+            WriteString(v.View());
+        else if constexpr (std::is_same_v<Type, PackedArray>)
+            throw std::runtime_error("Heap pointers can't be saved to a snapshot");
+        else
+            Write(v);
+    }, value);
+}
+
+void Snapshot::WriteString(const std::string_view string)
+{
+    Write<uint32_t>(string.size());
+    output.write(string.data(), static_cast<std::streamsize>(string.size()));
+}
+
+ExprPtr Snapshot::ReadNode()
+{
+    switch(Read<NodeType>())
+    {
+    case NodeType::None: return nullptr;
+    case NodeType::Value: return MakeNode<ValueExpr>(ReadValue());
+    case NodeType::Variable: return MakeNode<VariableExpr>(ReadString());
+    case NodeType::VariableDecl:
+    {
+        auto name = ReadString();
+        return MakeNode<VariableDecl>(std::move(name), ReadNode());
+    }
+    case NodeType::ArrayDecl:
+    {
+        auto name = ReadString();
+        return MakeNode<ArrayDecl>(std::move(name), ReadNode());
+    }
+    case NodeType::Return: return MakeNode<ReturnExpr>(ReadNode());
+    case NodeType::Break: return MakeNode<BreakExpr>();
+    case NodeType::Continue: return MakeNode<ContinueExpr>();
+    case NodeType::StatementList:
+    {
+        const auto noLocalScope = Read<bool>();
+        const auto isAsync = Read<bool>();
+        const auto isGenerator = Read<bool>();
+        auto args = ReadNodes();
+        auto list = MakeNode<StatementList>(ReadNodes(), std::move(args));
+        list->noLocalScope = noLocalScope;
+        list->isAsync = isAsync;
+        list->isGenerator = isGenerator;
+
+        return list;
+    }
+    case NodeType::FunctionDecl:
+    {
+        auto name = ReadString();
+        return MakeNode<FunctionDecl>(std::move(name), ReadNode());
+    }
+    case NodeType::StructDecl:
+    {
+        auto structDecl = MakeNode<StructDecl>(ReadString());
+
+        for(auto count = Read<uint32_t>(); count > 0; count--)
+        {
+            auto name = ReadString();
+            structDecl->content[name] = ReadNode();
+        }
+
+        for(auto count = Read<uint32_t>(); count > 0; count--)
+            structDecl->order.push_back(ReadString());
+
+        for(auto count = Read<uint32_t>(); count > 0; count--)
+            structDecl->arrays.push_back(ReadString());
+
+        return structDecl;
+    }
+    case NodeType::Constructor:
+    {
+        auto name = ReadString();
+        return MakeNode<ConstructorExpr>(std::move(name), ReadNodes());
+    }
+    case NodeType::If:
+    {
+        auto condition = ReadNode();
+        auto then = ReadNode();
+        return MakeNode<IfStatement>(std::move(condition), std::move(then), ReadNode());
+    }
+    case NodeType::While:
+    {
+        auto condition = ReadNode();
+        return MakeNode<WhileStatement>(std::move(condition), ReadNode());
+    }
+    case NodeType::For:
+    {
+        auto init = ReadNode();
+        auto condition = ReadNode();
+        auto step = ReadNode();
+        return MakeNode<ForStatement>(std::move(init), std::move(condition), std::move(step), ReadNode());
+    }
+    case NodeType::ParallelFor:
+    {
+        auto name = ReadString();
+        auto begin = ReadNode();
+        auto end = ReadNode();
+        return MakeNode<ParallelForStatement>(std::move(name), std::move(begin), std::move(end), ReadNode());
+    }
+    case NodeType::ForIn:
+    {
+        auto name = ReadString();
+        auto iterable = ReadNode();
+        return MakeNode<ForInStatement>(std::move(name), std::move(iterable), ReadNode());
+    }
+    case NodeType::Yield: return MakeNode<YieldExpr>(ReadNode());
+    case NodeType::Await: return MakeNode<AwaitExpr>(ReadNode());
+    case NodeType::FunctionCall:
+    {
+        auto name = ReadString();
+        return MakeNode<FunctionCall>(std::move(name), ReadNodes());
+    }
+    case NodeType::Index:
+    {
+        auto expr = ReadNode();
+        return MakeNode<IndexExpr>(std::move(expr), ReadNode());
+    }
+    case NodeType::Unary:
+    {
+        const auto operation = Read<Lexer::TokenType>();
+        const auto operationFirst = Read<bool>();
+
+        auto unary = MakeNode<UnaryExpr>(operation, ReadNode());
+        unary->operationFirst = operationFirst;
+
+        return unary;
+    }
+    case NodeType::Binary:
+    {
+        const auto operation = Read<Lexer::TokenType>();
+        auto left = ReadNode();
+        return MakeNode<BinaryExpr>(operation, std::move(left), ReadNode());
+    }
+    case NodeType::Flat:
+    {
+        std::pmr::vector<FlatExpr::Node> nodes(nodeArena);
+        nodes.resize(Read<uint32_t>());
+        for(auto& [kind, operation, left, right] : nodes)
+        {
+            kind = Read<FlatExpr::Node::Kind>();
+            operation = Read<Lexer::TokenType>();
+            left = Read<uint32_t>();
+            right = Read<uint32_t>();
+        }
+
+        std::pmr::vector<Value> constants(nodeArena);
+        constants.resize(Read<uint32_t>());
+        for(auto& constant : constants)
+            constant = ReadValue();
+
+        std::pmr::vector<std::string> names(nodeArena);
+        names.resize(Read<uint32_t>());
+        for(auto& name : names)
+            name = ReadString();
+
+        return MakeNode<FlatExpr>(std::move(nodes), std::move(constants), std::move(names));
+    }
+    }
+
+    throw std::runtime_error("Unknown expression in snapshot");
+}
+
+std::vector<ExprPtr> Snapshot::ReadNodes()
+{
+    std::vector<ExprPtr> nodes(Read<uint32_t>());
+    for(auto& i : nodes)
+        i = ReadNode();
+
+    return nodes;
+}
+
+Value Snapshot::ReadValue()
+{
+    // Indices follow the order of the Value alternatives
+    switch(Read<uint8_t>())
+    {
+    case 0: return Read<int>();
+    case 1: return Read<size_t>();
+    case 2: return Read<float>();
+    case 3: return Read<double>();
+    case 4: return Read<bool>();
+    case 5: return Read<char>();
+    case 6: return String(ReadString());
+    default: break;
+    }
+
+    throw std::runtime_error("Unknown value in snapshot");
+}
+
+std::string Snapshot::ReadString()
+{
+    std::string string(Read<uint32_t>(), '\0');
+    if(!input.read(string.data(), static_cast<std::streamsize>(string.size())))
+        throw std::runtime_error("Unexpected end of snapshot");
+
+    return string;
+}
@@ -0,0 +1,261 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+constexpr size_t notWorker = std::numeric_limits<size_t>::max();
+
+}
+
+thread_local size_t ThreadPool::workerIndex = notWorker;
+
+ThreadPool::ThreadPool(const size_t threadCount)
+{
+    for(size_t i = 0; i < threadCount; i++)
+        queues.push_back(std::make_unique<Queue>());
+
+    for(size_t i = 0; i < threadCount; i++)
+        threads.emplace_back([this, i] { Work(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        const std::lock_guard lock(sleepMutex);
+        stopping = true;
+    }
+
+    wakeUp.notify_all();
+
+    // Jobs that nobody waited for are dropped
+    threads.clear();
+}
+
+ThreadPool& ThreadPool::Get()
+{
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+void ThreadPool::Submit(Job job)
+{
+    const auto index = workerIndex != notWorker ? workerIndex : nextQueue++ % queues.size();
+
+    {
+        const std::lock_guard lock(queues[index]->mutex);
+        queues[index]->jobs.push_back(std::move(job));
+    }
+
+    pending++;
+
+    {
+        const std::lock_guard lock(sleepMutex);
+    }
+
+    wakeUp.notify_one();
+}
+
+void ThreadPool::Wait(const std::atomic<bool>& done)
+{
+    while(!done.load(std::memory_order_acquire))
+    {
+        if(RunOne(workerIndex))
+            continue;
+
+        // Nothing is queued, so the job is running on another thread
+        done.wait(false, std::memory_order_acquire);
+    }
+}
+
+void ThreadPool::Wait(const std::atomic<size_t>& count)
+{
+    for(auto left = count.load(std::memory_order_acquire); left; left = count.load(std::memory_order_acquire))
+    {
+        if(RunOne(workerIndex))
+            continue;
+
+        count.wait(left, std::memory_order_acquire);
+    }
+}
+
+void ThreadPool::For(const int64_t begin, const int64_t end, const size_t participants, const Participant& participant)
+{
+    if(begin >= end)
+        return;
+
+    const auto count = static_cast<size_t>(std::clamp<int64_t>(end - begin, 1, std::max<size_t>(participants, 1)));
+
+    const auto ranges = std::make_unique<Range[]>(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        ranges[i].from = begin + (end - begin) * static_cast<int64_t>(i) / static_cast<int64_t>(count);
+        ranges[i].to = begin + (end - begin) * static_cast<int64_t>(i + 1) / static_cast<int64_t>(count);
+    }
+
+    std::atomic<bool> stopped{};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    const auto take = [&](const size_t index, int64_t& from, int64_t& to)
+    {
+        auto& own = ranges[index];
+
+        while(!stopped.load(std::memory_order_relaxed))
+        {
+            {
+                const std::lock_guard lock(own.mutex);
+
+                // Chunks get smaller as the part empties, so the last ones balance the load
+                if(const auto left = own.to - own.from; left > 0)
+                {
+                    from = own.from;
+                    to = own.from += std::max<int64_t>(1, left / 8);
+
+                    return true;
+                }
+            }
+
+            size_t victim = index;
+            int64_t largest = 0;
+
+            for(size_t i = 0; i < count; i++)
+            {
+                const std::lock_guard lock(ranges[i].mutex);
+                if(const auto left = ranges[i].to - ranges[i].from; left > largest)
+                {
+                    victim = i;
+                    largest = left;
+                }
+            }
+
+            if(victim == index)
+                return false;
+
+            int64_t stolenFrom, stolenTo;
+            {
+                const std::lock_guard lock(ranges[victim].mutex);
+
+                const auto left = ranges[victim].to - ranges[victim].from;
+                if(left <= 0)
+                    continue;
+
+                stolenTo = ranges[victim].to;
+                stolenFrom = ranges[victim].to -= (left + 1) / 2;
+            }
+
+            const std::lock_guard lock(own.mutex);
+            own.from = stolenFrom;
+            own.to = stolenTo;
+        }
+
+        return false;
+    };
+
+    const auto run = [&](const size_t index)
+    {
+        try
+        {
+            participant([&](int64_t& from, int64_t& to) { return take(index, from, to); });
+        }
+        catch(...)
+        {
+            const std::lock_guard lock(errorMutex);
+            if(!error)
+                error = std::current_exception();
+
+            stopped = true;
+        }
+    };
+
+    const auto done = std::make_unique<std::atomic<bool>[]>(count);
+
+    for(size_t i = 1; i < count; i++)
+        Submit([&, i]
+        {
+            run(i);
+
+            done[i].store(true, std::memory_order_release);
+            done[i].notify_all();
+        });
+
+    run(0);
+
+    for(size_t i = 1; i < count; i++)
+        Wait(done[i]);
+
+    if(error)
+        std::rethrow_exception(error);
+}
+
+size_t ThreadPool::GetThreadCount() const
+{
+    return threads.size();
+}
+
+void ThreadPool::Work(const size_t index)
+{
+    workerIndex = index;
+
+    while(true)
+    {
+        if(RunOne(index))
+            continue;
+
+        std::unique_lock lock(sleepMutex);
+        wakeUp.wait(lock, [this] { return stopping || pending.load() > 0; });
+
+        if(stopping)
+            return;
+    }
+}
+
+bool ThreadPool::RunOne(const size_t index)
+{
+    const auto job = Take(index);
+    if(!job)
+        return false;
+
+    job();
+
+    return true;
+}
+
+ThreadPool::Job ThreadPool::Take(const size_t index)
+{
+    if(index != notWorker)
+    {
+        auto& own = *queues[index];
+        const std::lock_guard lock(own.mutex);
+
+        if(!own.jobs.empty())
+        {
+            auto job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            pending--;
+
+            return job;
+        }
+    }
+
+    const auto start = index != notWorker ? index + 1 : nextQueue.load();
+
+    for(size_t i = 0; i < queues.size(); i++)
+    {
+        auto& victim = *queues[(start + i) % queues.size()];
+        const std::lock_guard lock(victim.mutex);
+
+        if(!victim.jobs.empty())
+        {
+            auto job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            pending--;
+
+            return job;
+        }
+    }
+
+    return {};
+}